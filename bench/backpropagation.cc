@@ -0,0 +1,124 @@
+/*
+ * Error backpropagation (4.122) with division by weights against the
+ * transposed product with cached reciprocal weights. Times the backward
+ * pass of batch learning (accumulate()) and an online learning epoch,
+ * and compares errors calculated both ways
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <cstdlib>
+#include "mlmvn.h"
+
+using namespace std;
+using namespace klogic;
+
+typedef chrono::steady_clock bench_clock;
+
+const int nsamples = 256;
+
+double seconds_since(bench_clock::time_point start)
+{
+    return chrono::duration<double>(bench_clock::now() - start).count();
+}
+
+cvector random_phases(int n)
+{
+    cvector v(n);
+
+    for (int i = 0; i < n; ++i)
+        v[i] = polar(scalar(1), scalar(TWOPI * rand() / RAND_MAX));
+
+    return v;
+}
+
+// Make caches of all layers stale, so backpropagation divides
+void invalidate(mlmvn &net)
+{
+    for (size_t layer = 0; layer < net.layers_count(); ++layer)
+        net.layer_weights(layer);
+}
+
+int main()
+{
+    vector<int> sizes(4), k_values(3, 0);
+
+    sizes[0] = 64;
+    sizes[1] = 512;
+    sizes[2] = 512;
+    sizes[3] = 16;
+
+    mlmvn net(sizes, k_values);
+    vector<cvector> X, errors;
+
+    for (int s = 0; s < nsamples; ++s) {
+        X.push_back(random_phases(sizes[0]));
+        errors.push_back(random_phases(sizes[3]));
+    }
+
+    cout << "Network 64-512-512-16, " << nsamples << " samples" << endl << endl;
+    cout << setw(16) << "mode" << setw(16) << "accumulate, s" << setw(16) << "online, s" << endl;
+
+    mlmvn_workspace ws(net);
+    mlmvn_gradient g(net);
+    vector<cvector> hidden[2];
+
+    for (int cached = 0; cached < 2; ++cached) {
+        if (cached)
+            net.update_reciprocals();
+        else
+            invalidate(net);
+
+        // Batch learning: weights don't change, errors of hidden layers
+        // are kept for comparison
+        bench_clock::time_point start = bench_clock::now();
+
+        for (int s = 0; s < nsamples; ++s) {
+            net.forward(X[s], ws);
+            net.accumulate(X[s], errors[s], 1.0, ws, g);
+
+            hidden[cached].push_back(ws.errors[0]);
+        }
+
+        double batch_time = seconds_since(start);
+
+        // Online learning: every correction refreshes the cache
+        mlmvn online(net);
+
+        if (!cached)
+            invalidate(online);
+
+        start = bench_clock::now();
+
+        for (int s = 0; s < nsamples; ++s) {
+            if (!cached)
+                invalidate(online);
+
+            online.forward(X[s], ws);
+            online.learn_forwarded(X[s], errors[s], 1.0, ws);
+        }
+
+        double online_time = seconds_since(start);
+
+        cout << setw(16) << (cached ? "reciprocals" : "division") << fixed << setprecision(4)
+             << setw(16) << batch_time << setw(16) << online_time << endl;
+    }
+
+    // Relative difference of first hidden layer errors
+    double worst = 0;
+
+    for (int s = 0; s < nsamples; ++s) {
+        for (size_t k = 0; k < hidden[0][s].size(); ++k) {
+            double a = abs(hidden[0][s][k]), d = abs(hidden[0][s][k] - hidden[1][s][k]);
+
+            if (a > 0)
+                worst = max(worst, d / a);
+        }
+    }
+
+    cout << endl << "largest relative difference of errors: " << scientific << setprecision(2)
+         << worst << endl;
+
+    return 0;
+}
@@ -0,0 +1,73 @@
+/*
+ * Compare per-sample mlmvn_forward with mlmvn_batch_forward for several
+ * block sizes
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <cstdlib>
+#include "mlmvn.h"
+
+using namespace std;
+using namespace klogic;
+
+typedef chrono::steady_clock bench_clock;
+
+const int nsamples = 4096;
+
+double seconds_since(bench_clock::time_point start)
+{
+    return chrono::duration<double>(bench_clock::now() - start).count();
+}
+
+int main()
+{
+    vector<int> sizes(4), k_values(3, 0);
+
+    sizes[0] = 256;
+    sizes[1] = 512;
+    sizes[2] = 512;
+    sizes[3] = 16;
+
+    mlmvn net(sizes, k_values);
+
+    aligned_cvector inputs(nsamples * sizes[0]);
+
+    for (size_t i = 0; i < inputs.size(); ++i)
+        inputs[i] = polar(1.0, TWOPI * rand() / RAND_MAX);
+
+    aligned_cvector outputs(nsamples * net.output_layer_size());
+
+    cout << "Network 256-512-512-16, " << nsamples << " samples" << endl << endl;
+    cout << setw(16) << "mode" << setw(16) << "samples/s" << endl;
+
+    // Baseline: one sample at a time
+    {
+        mlmvn_forward forward(net);
+        cvector X(sizes[0]), Y(net.output_layer_size());
+
+        bench_clock::time_point start = bench_clock::now();
+
+        for (int s = 0; s < nsamples; ++s) {
+            copy(inputs.begin() + s * sizes[0], inputs.begin() + (s + 1) * sizes[0], X.begin());
+            forward.output(X, Y.begin());
+        }
+
+        cout << setw(16) << "mlmvn_forward" << setw(16) << fixed << setprecision(0)
+             << nsamples / seconds_since(start) << endl;
+    }
+
+    for (size_t batch = 1; batch <= 256; batch *= 4) {
+        mlmvn_batch_forward forward(net, batch);
+
+        bench_clock::time_point start = bench_clock::now();
+
+        forward.output(&inputs[0], nsamples, &outputs[0]);
+
+        cout << setw(10) << "batch " << setw(6) << batch << setw(16)
+             << nsamples / seconds_since(start) << endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,164 @@
+/*
+ * Per-sample classification written by hand (mlmvn_forward, then
+ * sector_number() or a phase loop for each output) against
+ * mlmvn_classifier, which decodes whole blocks. Both schemes of
+ * class_decoder are measured: one output neuron with rejection sectors
+ * and winner take all among one neuron per class. Decoding alone is
+ * timed too, on the same output values
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <cstdlib>
+#include "mlmvn.h"
+#include "classifier.h"
+
+using namespace std;
+using namespace klogic;
+
+typedef chrono::steady_clock bench_clock;
+
+const int nsamples = 8192;
+const int classes  = 10;
+
+// Parts of a class sector for class_decoder::rejecting()
+const int sectors_per_class = 8;
+
+double seconds_since(bench_clock::time_point start)
+{
+    return chrono::duration<double>(bench_clock::now() - start).count();
+}
+
+// Hand-written decoders of one sample, as used before class_decoder
+int decode_sector(const cmplx &z, const vector<int> &labels)
+{
+    return labels[sector_number(int(labels.size()), z) % labels.size()];
+}
+
+int decode_winner(const cmplx *z, size_t outputs)
+{
+    int best = 0;
+
+    for (size_t j = 1; j < outputs; ++j) {
+        if (cos(phase(z[j])) > cos(phase(z[best])))
+            best = j;
+    }
+
+    return best;
+}
+
+void print(const char *scheme, const char *mode, double seconds, double agree)
+{
+    cout << setw(10) << scheme << setw(22) << mode << setw(14) << fixed << setprecision(0)
+         << nsamples / seconds << setw(12) << setprecision(1) << 100 * agree << endl;
+}
+
+void run(const char *scheme, const vector<int> &sizes, const class_decoder &decoder,
+         const vector<int> &sector_labels)
+{
+    vector<int> k_values(sizes.size() - 1, 0);
+    mlmvn net(sizes, k_values);
+
+    size_t in_size = sizes.front(), out_size = sizes.back();
+    aligned_cvector inputs(nsamples * in_size);
+
+    for (size_t i = 0; i < inputs.size(); ++i)
+        inputs[i] = polar(scalar(1), scalar(TWOPI * rand() / RAND_MAX));
+
+    vector<int> expected(nsamples), labels(nsamples);
+    aligned_cvector outputs(nsamples * out_size);
+
+    // Per sample: forward pass and decoding
+    {
+        mlmvn_forward forward(net);
+        cvector X(in_size), Y(out_size);
+
+        bench_clock::time_point start = bench_clock::now();
+
+        for (int s = 0; s < nsamples; ++s) {
+            copy(inputs.begin() + s * in_size, inputs.begin() + (s + 1) * in_size, X.begin());
+            forward.output(X, Y.begin());
+            copy(Y.begin(), Y.end(), outputs.begin() + s * out_size);
+
+            expected[s] = out_size == 1 ? decode_sector(Y[0], sector_labels)
+                                        : decode_winner(Y.data(), out_size);
+        }
+
+        print(scheme, "per sample", seconds_since(start), 1.0);
+    }
+
+    // The same network through mlmvn_classifier
+    {
+        mlmvn_classifier classifier(net, decoder);
+
+        bench_clock::time_point start = bench_clock::now();
+
+        classifier.classify(inputs.data(), nsamples, labels.data());
+
+        double seconds = seconds_since(start);
+        int same = 0;
+
+        for (int s = 0; s < nsamples; ++s)
+            same += labels[s] == expected[s];
+
+        print(scheme, "mlmvn_classifier", seconds, double(same) / nsamples);
+    }
+
+    // Decoding only. Outputs of continuous neurons have the phases of
+    // their weighted sums, so both decoders get the same values
+    {
+        bench_clock::time_point start = bench_clock::now();
+
+        for (int s = 0; s < nsamples; ++s) {
+            const cmplx *Y = outputs.data() + s * out_size;
+
+            labels[s] = out_size == 1 ? decode_sector(Y[0], sector_labels)
+                                      : decode_winner(Y, out_size);
+        }
+
+        print(scheme, "decode per sample", seconds_since(start), 1.0);
+
+        start = bench_clock::now();
+        decoder.decode(outputs.data(), nsamples, labels.data());
+
+        double seconds = seconds_since(start);
+        int same = 0;
+
+        for (int s = 0; s < nsamples; ++s)
+            same += labels[s] == expected[s];
+
+        print(scheme, "class_decoder", seconds, double(same) / nsamples);
+    }
+}
+
+int main()
+{
+    class_decoder rejecting = class_decoder::rejecting(classes, sectors_per_class);
+    vector<int> sector_labels(classes * sectors_per_class);
+
+    for (size_t s = 0; s < sector_labels.size(); ++s) {
+        int part = s % sectors_per_class;
+
+        sector_labels[s] = (part == 0 || part == sectors_per_class - 1)
+                         ? class_decoder::REJECTED : int(s / sectors_per_class);
+    }
+
+    cout << nsamples << " samples, " << classes << " classes" << endl << endl;
+    cout << setw(10) << "scheme" << setw(22) << "mode" << setw(14) << "samples/s"
+         << setw(12) << "same, %" << endl;
+
+    vector<int> sizes(3);
+
+    sizes[0] = 64;
+    sizes[1] = 128;
+    sizes[2] = 1;
+
+    run("sectors", sizes, rejecting, sector_labels);
+
+    sizes[2] = classes;
+
+    run("winner", sizes, class_decoder::winner(classes), vector<int>());
+
+    return 0;
+}
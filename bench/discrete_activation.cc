@@ -0,0 +1,114 @@
+/*
+ * Discrete activation: klogic::activation() (atan2 + sin/cos) against
+ * table-driven kernels::activation() and kernels::activate() for whole
+ * layers. Also checks that all three give bitwise identical results,
+ * including values right at sector borders
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include "klogic.h"
+#include "kernels.h"
+
+using namespace std;
+using namespace klogic;
+
+typedef chrono::steady_clock bench_clock;
+
+const int nvalues = 1 << 16;
+const int rounds  = 20;
+
+double seconds_since(bench_clock::time_point start)
+{
+    return chrono::duration<double>(bench_clock::now() - start).count();
+}
+
+double random_unit()
+{
+    return double(rand()) / RAND_MAX;
+}
+
+// Random values, every fourth one lies at a sector border or next to it
+cvector test_values(int k)
+{
+    cvector z(nvalues);
+
+    for (int i = 0; i < nvalues; ++i) {
+        double r = 0.01 + 100 * random_unit();
+
+        if (i % 4 == 0) {
+            double border = TWOPI * (rand() % (k + 1)) / k;
+            double shift  = (rand() % 3 - 1) * 1e-12 * (rand() % 1000);
+
+            z[i] = polar(r, border + shift);
+        } else
+            z[i] = polar(r, TWOPI * random_unit());
+    }
+
+    // Special values
+    z[1] = cmplx(0, 0);
+    z[3] = cmplx(-1, 0);
+    z[5] = cmplx(-1, -0.0);
+    z[7] = cmplx(1, -1e-300);
+
+    return z;
+}
+
+int main()
+{
+    const int ks[] = { 2, 4, 16, 256, 4096 };
+
+    cout << nvalues << " values x " << rounds << " rounds" << endl << endl;
+    cout << setw(6) << "k" << setw(14) << "reference, s" << setw(14) << "scalar, s"
+         << setw(14) << "layer, s" << setw(10) << "speedup" << setw(12) << "mismatches" << endl;
+
+    for (size_t ik = 0; ik < sizeof(ks) / sizeof(ks[0]); ++ik) {
+        int k = ks[ik];
+        cvector z = test_values(k);
+        cvector reference(nvalues), scalar(nvalues), layer(nvalues);
+
+        bench_clock::time_point start = bench_clock::now();
+
+        for (int round = 0; round < rounds; ++round) {
+            for (int i = 0; i < nvalues; ++i)
+                reference[i] = activation(k, z[i]);
+        }
+
+        double t_reference = seconds_since(start);
+
+        start = bench_clock::now();
+
+        for (int round = 0; round < rounds; ++round) {
+            for (int i = 0; i < nvalues; ++i)
+                scalar[i] = kernels::activation(k, z[i]);
+        }
+
+        double t_scalar = seconds_since(start);
+
+        start = bench_clock::now();
+
+        for (int round = 0; round < rounds; ++round) {
+            layer = z;
+            kernels::activate(k, &layer[0], nvalues);
+        }
+
+        double t_layer = seconds_since(start);
+
+        int mismatches = 0;
+
+        for (int i = 0; i < nvalues; ++i) {
+            if (memcmp(&reference[i], &scalar[i], sizeof(cmplx)) != 0
+                    || memcmp(&reference[i], &layer[i], sizeof(cmplx)) != 0)
+                ++mismatches;
+        }
+
+        cout << setw(6) << k << setw(14) << t_reference << setw(14) << t_scalar
+             << setw(14) << t_layer << setw(10) << setprecision(3) << t_reference / t_layer
+             << setw(12) << mismatches << setprecision(6) << endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,117 @@
+/*
+ * Convergence against wall-clock time of serial online learning
+ * (teacher::learn_run) and lock-free asynchronous learning
+ * (mlmvn_hogwild_learner) for growing thread counts. Inputs are sparse:
+ * most of them are zero, so corrections of the first layer touch few
+ * weights. Desired outputs come from another random network
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <cstdlib>
+#include "mlmvn.h"
+#include "learning.h"
+#include "parallel.h"
+
+using namespace std;
+using namespace klogic;
+
+typedef chrono::steady_clock bench_clock;
+typedef learning::sample<cvector> sample_type;
+
+const int nsamples = 4096;
+const int nonzero  = 8;
+const int epochs   = 5;
+
+double seconds_since(bench_clock::time_point start)
+{
+    return chrono::duration<double>(bench_clock::now() - start).count();
+}
+
+class square_error {
+public:
+    double operator()(const sample_type &sample, const cvector &actual) const {
+        double result = 0;
+
+        for (size_t i = 0; i < actual.size(); ++i)
+            result += norm(sample.desired[i] - actual[i]);
+
+        return result;
+    }
+};
+
+// Run epochs with learn(net) and print time and MSE after each one
+template<typename Learn>
+void converge(const char *name, mlmvn &net, const vector<sample_type> &samples, Learn learn)
+{
+    learning::teacher<mlmvn> evaluation(net, samples);
+    double elapsed = 0;
+
+    cout << setw(12) << name;
+
+    for (int epoch = 0; epoch < epochs; ++epoch) {
+        bench_clock::time_point start = bench_clock::now();
+
+        learn();
+        elapsed += seconds_since(start);
+
+        cout << setw(9) << setprecision(3) << elapsed << "s " << setw(7) << setprecision(4)
+             << evaluation.mse(square_error());
+    }
+
+    cout << endl;
+}
+
+int main()
+{
+    vector<int> sizes(3), k_values(2, 0);
+
+    sizes[0] = 1024;
+    sizes[1] = 64;
+    sizes[2] = 4;
+
+    const mlmvn target(sizes, k_values), initial(sizes, k_values);
+
+    vector<sample_type> samples;
+
+    for (int i = 0; i < nsamples; ++i) {
+        cvector X(sizes[0]);
+
+        for (int j = 0; j < nonzero; ++j)
+            X[rand() % sizes[0]] = polar(scalar(1), scalar(TWOPI * rand() / RAND_MAX));
+
+        samples.push_back(sample_type(X, target.output(X)));
+    }
+
+    int max_threads = parallel_options().thread_count();
+
+    cout << "Network 1024-64-4, " << nsamples << " samples with " << nonzero
+         << " nonzero inputs, up to " << max_threads << " threads" << endl;
+    cout << "Elapsed time and MSE after each of " << epochs << " epochs" << endl << endl;
+    cout << fixed;
+
+    mlmvn serial(initial);
+    learning::teacher<mlmvn> teacher(serial, samples);
+
+    converge("serial", serial, samples, [&]() { teacher.learn_run(); });
+
+    for (int threads = 1; threads <= max_threads; threads *= 2) {
+        parallel_options options;
+
+        options.threads = threads;
+
+        mlmvn net(initial);
+        net.set_parallel(options);
+
+        mlmvn_hogwild_learner learner(net);
+        string name = "hogwild " + to_string(threads);
+
+        converge(name.c_str(), net, samples, [&]() {
+            learner.learn_run<vector<sample_type>::const_iterator, learning::learn_always<sample_type> >(
+                samples.begin(), samples.end());
+        });
+    }
+
+    return 0;
+}
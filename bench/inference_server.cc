@@ -0,0 +1,123 @@
+/*
+ * Load generator for mlmvn_executor. Client threads send requests one at
+ * a time and wait for each answer (closed loop). Requests either run in
+ * the client thread (mlmvn_workspace_pool, one forward pass per request)
+ * or go through the executor with several batch sizes. Reports
+ * throughput and p50/p99 latency
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <thread>
+#include "mlmvn.h"
+#include "executor.h"
+#include "workspace_pool.h"
+
+using namespace std;
+using namespace klogic;
+
+typedef chrono::steady_clock bench_clock;
+
+const int requests_per_client = 400;
+
+double seconds_since(bench_clock::time_point start)
+{
+    return chrono::duration<double>(bench_clock::now() - start).count();
+}
+
+// Run clients calling request(X) and print statistics
+template<typename Request>
+void load(const char *name, size_t clients, const vector<cvector> &inputs, Request request)
+{
+    vector<vector<double> > latencies(clients);
+    vector<thread> threads;
+
+    bench_clock::time_point start = bench_clock::now();
+
+    for (size_t c = 0; c < clients; ++c) {
+        threads.push_back(thread([&, c]() {
+            for (int r = 0; r < requests_per_client; ++r) {
+                bench_clock::time_point sent = bench_clock::now();
+
+                request(inputs[(c * requests_per_client + r) % inputs.size()]);
+                latencies[c].push_back(seconds_since(sent) * 1e6);
+            }
+        }));
+    }
+
+    for (size_t c = 0; c < clients; ++c)
+        threads[c].join();
+
+    double elapsed = seconds_since(start);
+    vector<double> all;
+
+    for (size_t c = 0; c < clients; ++c)
+        all.insert(all.end(), latencies[c].begin(), latencies[c].end());
+
+    sort(all.begin(), all.end());
+
+    cout << setw(16) << name << setw(10) << clients << setw(14) << fixed << setprecision(0)
+         << all.size() / elapsed << setw(12) << all[all.size() / 2]
+         << setw(12) << all[all.size() * 99 / 100] << endl;
+}
+
+int main()
+{
+    vector<int> sizes(3), k_values(2);
+
+    sizes[0] = 64;
+    sizes[1] = 256;
+    sizes[2] = 16;
+
+    k_values[0] = 0;
+    k_values[1] = 16;
+
+    mlmvn net(sizes, k_values);
+    vector<cvector> inputs(1024, cvector(sizes[0]));
+
+    for (size_t s = 0; s < inputs.size(); ++s) {
+        for (int i = 0; i < sizes[0]; ++i)
+            inputs[s][i] = polar(scalar(1), scalar(TWOPI * rand() / RAND_MAX));
+    }
+
+    cout << "Network 64-256-16, " << thread::hardware_concurrency() << " hardware threads" << endl << endl;
+    cout << setw(16) << "mode" << setw(10) << "clients" << setw(14) << "requests/s"
+         << setw(12) << "p50, us" << setw(12) << "p99, us" << endl;
+
+    size_t client_counts[] = { 1, 8, 32 };
+
+    for (size_t i = 0; i < 3; ++i) {
+        size_t clients = client_counts[i];
+
+        mlmvn_workspace_pool pool(net, clients);
+
+        load("direct", clients, inputs, [&](const cvector &X) {
+            cvector result(net.output_layer_size());
+
+            pool.output(X, result.data());
+        });
+
+        size_t batches[] = { 1, 8, 32 };
+
+        for (size_t j = 0; j < 3; ++j) {
+            executor_options options;
+
+            options.max_batch = batches[j];
+            options.max_delay = chrono::microseconds(100);
+
+            mlmvn_executor executor(net, options);
+            string name = "batch " + to_string(batches[j]);
+
+            load(name.c_str(), clients, inputs, [&](const cvector &X) {
+                executor.submit(X).get();
+            });
+        }
+
+        cout << endl;
+    }
+
+    return 0;
+}
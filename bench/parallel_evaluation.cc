@@ -0,0 +1,142 @@
+/*
+ * Time of MSE and hits evaluation: a serial loop over mlmvn::output(),
+ * teacher::mse() and teacher::hits() for growing thread counts, and a
+ * learning epoch followed by evaluation against one fused with it
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <cstdlib>
+#include "mlmvn.h"
+#include "learning.h"
+#include "parallel.h"
+
+using namespace std;
+using namespace klogic;
+
+typedef chrono::steady_clock bench_clock;
+typedef learning::sample<cvector> sample_type;
+
+const int nsamples = 8192;
+
+double seconds_since(bench_clock::time_point start)
+{
+    return chrono::duration<double>(bench_clock::now() - start).count();
+}
+
+cvector random_phases(int n)
+{
+    cvector v(n);
+
+    for (int i = 0; i < n; ++i)
+        v[i] = polar(scalar(1), scalar(TWOPI * rand() / RAND_MAX));
+
+    return v;
+}
+
+class square_error {
+public:
+    double operator()(const sample_type &sample, const cvector &actual) const {
+        double result = 0;
+
+        for (size_t i = 0; i < actual.size(); ++i)
+            result += norm(sample.desired[i] - actual[i]);
+
+        return result;
+    }
+};
+
+class close_match {
+public:
+    bool operator()(const cvector &actual, const cvector &desired) const {
+        for (size_t i = 0; i < actual.size(); ++i) {
+            if (abs(actual[i] - desired[i]) > 0.5)
+                return false;
+        }
+
+        return true;
+    }
+};
+
+int main()
+{
+    vector<int> sizes(3), k_values(2, 0);
+
+    sizes[0] = 64;
+    sizes[1] = 256;
+    sizes[2] = 8;
+
+    mlmvn net(sizes, k_values);
+
+    vector<sample_type> samples;
+
+    for (int i = 0; i < nsamples; ++i)
+        samples.push_back(sample_type(random_phases(sizes[0]), random_phases(sizes[2])));
+
+    int max_threads = parallel_options().thread_count();
+
+    cout << "Network 64-256-8, " << nsamples << " samples, up to "
+         << max_threads << " threads" << endl << endl;
+
+    // What teacher::mse() did before: one allocating output() per sample
+    bench_clock::time_point start = bench_clock::now();
+    square_error sq_err;
+    double serial_error = 0;
+
+    for (size_t i = 0; i < samples.size(); ++i)
+        serial_error += sq_err(samples[i], net.output(samples[i].input));
+
+    double serial_time = seconds_since(start);
+
+    cout << setw(8) << "threads" << setw(12) << "mse, s" << setw(12) << "hits, s"
+         << setw(16) << "same as 1" << endl;
+    cout << setw(8) << "serial" << fixed << setprecision(4) << setw(12) << serial_time << endl;
+
+    learning::teacher<mlmvn> teacher(net, samples);
+    double reference = 0;
+
+    for (int threads = 1; threads <= max_threads; threads *= 2) {
+        teacher.set_threads(threads);
+
+        start = bench_clock::now();
+        double mse = teacher.mse(sq_err);
+        double mse_time = seconds_since(start);
+
+        start = bench_clock::now();
+        teacher.hits<close_match>();
+        double hits_time = seconds_since(start);
+
+        if (threads == 1)
+            reference = mse;
+
+        // Chunk sums are added in the same order for any thread count
+        cout << setw(8) << threads << setw(12) << mse_time << setw(12) << hits_time
+             << setw(16) << (mse == reference ? "yes" : "NO") << endl;
+    }
+
+    cout << endl << "MSE: serial " << setprecision(9) << serial_error / nsamples
+         << ", teacher " << reference << endl << endl;
+
+    // Epoch with metrics: a separate evaluation pass against one measured
+    // on the learning pass outputs
+    teacher.set_threads(0);
+
+    start = bench_clock::now();
+    teacher.learn_run();
+    double separate_mse = teacher.mse(sq_err);
+    double separate_time = seconds_since(start);
+
+    learning::run_metrics<square_error, close_match> metrics;
+
+    start = bench_clock::now();
+    teacher.learn_run(learning::learn_always<sample_type>(), metrics);
+    double fused_time = seconds_since(start);
+
+    cout << setprecision(4) << "Learning run + mse(): " << separate_time << " s, MSE after run "
+         << separate_mse << endl;
+    cout << "Fused run:            " << fused_time << " s, MSE during run " << metrics.mse()
+         << ", " << metrics.hits() << " hits" << endl;
+
+    return 0;
+}
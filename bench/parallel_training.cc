@@ -0,0 +1,103 @@
+/*
+ * Epoch time of online learning with parallel layers and of data-parallel
+ * mini-batch learning for growing thread counts
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <cstdlib>
+#include "mlmvn.h"
+#include "learning.h"
+#include "parallel.h"
+
+using namespace std;
+using namespace klogic;
+
+typedef chrono::steady_clock bench_clock;
+typedef learning::sample<cvector> sample_type;
+
+const int nsamples   = 4096;
+const int batch_size = 256;
+
+double seconds_since(bench_clock::time_point start)
+{
+    return chrono::duration<double>(bench_clock::now() - start).count();
+}
+
+cvector random_phases(int n)
+{
+    cvector v(n);
+
+    for (int i = 0; i < n; ++i)
+        v[i] = polar(1.0, TWOPI * rand() / RAND_MAX);
+
+    return v;
+}
+
+int main()
+{
+    vector<int> sizes(4), k_values(3, 0);
+
+    sizes[0] = 64;
+    sizes[1] = 256;
+    sizes[2] = 256;
+    sizes[3] = 8;
+
+    const mlmvn initial(sizes, k_values);
+
+    vector<sample_type> samples;
+
+    for (int i = 0; i < nsamples; ++i)
+        samples.push_back(sample_type(random_phases(sizes[0]), random_phases(sizes[3])));
+
+    int max_threads = parallel_options().thread_count();
+
+    cout << "Network 64-256-256-8, " << nsamples << " samples, up to "
+         << max_threads << " threads" << endl << endl;
+    cout << setw(8) << "threads" << setw(16) << "online, s" << setw(16) << "batch " << batch_size << ", s"
+         << setw(16) << "reproducible" << endl;
+
+    for (int threads = 1; threads <= max_threads; threads *= 2) {
+        parallel_options options;
+
+        options.threads = threads;
+        options.min_layer_weights = 4096;
+
+        // Online learning, layers split between threads
+        mlmvn online(initial);
+        online.set_parallel(options);
+
+        learning::teacher<mlmvn> teacher(online, samples);
+
+        bench_clock::time_point start = bench_clock::now();
+        teacher.learn_run();
+        double online_time = seconds_since(start);
+
+        // Mini-batch learning, samples split between threads. Run twice
+        // to check that results are the same
+        cvector weights[2];
+        vector<int> k_out;
+        double batch_time = 0;
+
+        for (int run = 0; run < 2; ++run) {
+            mlmvn batch(initial);
+            batch.set_parallel(options);
+
+            mlmvn_parallel_learner learner(batch);
+
+            start = bench_clock::now();
+            learner.learn_run<vector<sample_type>::const_iterator, learning::learn_always<sample_type> >(
+                samples.begin(), samples.end(), batch_size);
+            batch_time = seconds_since(start);
+
+            batch.export_neurons(weights[run], k_out);
+        }
+
+        cout << setw(8) << threads << fixed << setprecision(3)
+             << setw(16) << online_time << setw(16) << batch_time
+             << setw(16) << (weights[0] == weights[1] ? "yes" : "NO") << endl;
+    }
+
+    return 0;
+}
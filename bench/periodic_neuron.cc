@@ -0,0 +1,227 @@
+/*
+ * Single MVN-P (periodic activation) against MLMVN of plain MVNs on
+ * non-threshold functions: parity of n bits (k = 2) and sum of n values
+ * modulo 3 (k = 3). An MVN-P with l periods learns them alone, plain
+ * MVNs need a hidden layer; for each function the smallest hidden layer
+ * that learns it within the epochs limit is used. The same MVN-P is also
+ * learned as a one-layer mlmvn with a periodic layer, and a hidden layer
+ * of MVN-Ps is learned under a plain discrete output neuron; learning
+ * through a periodic hidden layer is much less reliable. Prints learning
+ * epochs ("-" if not learned), weights count (model size) and inference
+ * time per sample
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <cstdlib>
+#include "mvn.h"
+#include "mlmvn.h"
+#include "learning.h"
+#include "transforms.h"
+
+using namespace std;
+using namespace klogic;
+
+typedef chrono::steady_clock bench_clock;
+
+const int max_epochs = 20000;
+
+// Hidden layer sizes tried are 2, 4, ..., max_hidden
+const int max_hidden = 16;
+
+// Hidden layer size of the network with a periodic hidden layer
+const int periodic_hidden = 4;
+
+// Samples evaluated for inference time
+const int inference_samples = 1 << 18;
+
+double seconds_since(bench_clock::time_point start)
+{
+    return chrono::duration<double>(bench_clock::now() - start).count();
+}
+
+// All n-digit inputs of k-valued logic and their sum modulo k
+template<int K>
+void make_samples(int n, vector<learning::sample<cmplx> > &single,
+                  vector<learning::sample<cvector> > &network)
+{
+    int total = 1;
+
+    for (int i = 0; i < n; ++i)
+        total *= K;
+
+    for (int c = 0; c < total; ++c) {
+        vector<int> x(n);
+        int sum = 0;
+
+        for (int i = 0, v = c; i < n; ++i, v /= K) {
+            x[i] = v % K;
+            sum += x[i];
+        }
+
+        single.push_back(transform::discrete<K, cmplx>(x, sum % K));
+        network.push_back(learning::sample<cvector>(single.back().input,
+                                                    cvector(1, single.back().desired)));
+    }
+}
+
+template<int K>
+struct output_match {
+    bool operator()(const cvector &output, const cvector &desired) const {
+        return sector_number(K, output[0]) == sector_number(K, desired[0]);
+    }
+};
+
+// Epochs until all samples are learned, 0 if max_epochs is not enough
+template<typename Learner, typename Sample, typename Match>
+int learn(Learner &learner, const vector<Sample> &samples, Match match)
+{
+    learning::teacher<Learner> teacher(learner, samples);
+
+    for (int epoch = 1; epoch <= max_epochs; ++epoch) {
+        teacher.learn_run();
+
+        if (teacher.hits(match) == teacher.samples_count())
+            return epoch;
+    }
+
+    return 0;
+}
+
+// Inference time per sample, inputs taken from samples in turn
+template<typename Output, typename Sample>
+double inference_ns(const vector<Sample> &samples, Output output)
+{
+    volatile scalar sink = 0;
+    bench_clock::time_point start = bench_clock::now();
+
+    for (int s = 0; s < inference_samples; ++s)
+        sink = sink + output(samples[s % samples.size()].input).real();
+
+    return seconds_since(start) * 1e9 / inference_samples;
+}
+
+void print(const string &function, const string &model, int epochs, size_t weights, double ns)
+{
+    cout << setw(12) << function << setw(18) << model << setw(10);
+
+    if (epochs)
+        cout << epochs;
+    else
+        cout << "-";
+
+    cout << setw(10) << weights << setw(12) << weights * sizeof(cmplx)
+         << setw(12) << fixed << setprecision(1) << ns << endl;
+}
+
+template<int K>
+void compare(const string &function, int n)
+{
+    vector<learning::sample<cmplx> >   single;
+    vector<learning::sample<cvector> > network;
+
+    make_samples<K>(n, single, network);
+
+    // n periods are enough for these functions
+    srand(1);
+
+    mvn neuron(K, n, n);
+    int epochs = learn(neuron, single, learning::single_discrete_match<K>());
+
+    print(function, "MVN-P l=" + to_string(n), epochs, n + 1,
+          inference_ns(single, [&](const cvector &X) { return neuron.output(X); }));
+
+    // The same neuron as a periodic mlmvn layer
+    {
+        vector<int> sizes(2), k_values(1, K), periods(1, n);
+
+        sizes[0] = n;
+        sizes[1] = 1;
+
+        srand(1);
+
+        mlmvn net(sizes, k_values, periods);
+        int net_epochs = learn(net, network, output_match<K>());
+
+        mlmvn_forward forward(net);
+        cvector Y(1);
+
+        print(function, "MLMVN " + to_string(n) + "-1 l=" + to_string(n), net_epochs, n + 1,
+              inference_ns(network, [&](const cvector &X) {
+                  forward.output(X, Y.begin());
+                  return Y[0];
+              }));
+    }
+
+    // Hidden layer of MVN-Ps, errors are backpropagated into it
+    {
+        vector<int> sizes(3), k_values(2, K), periods(2, 1);
+
+        sizes[0] = n;
+        sizes[1] = periodic_hidden;
+        sizes[2] = 1;
+
+        periods[0] = n;
+
+        srand(1);
+
+        mlmvn net(sizes, k_values, periods);
+        int net_epochs = learn(net, network, output_match<K>());
+
+        mlmvn_forward forward(net);
+        cvector Y(1);
+
+        print(function, "MLMVN " + to_string(n) + "-" + to_string(periodic_hidden) + "-1 l=" +
+              to_string(n) + ",1", net_epochs, periodic_hidden * (n + 1) + periodic_hidden + 1,
+              inference_ns(network, [&](const cvector &X) {
+                  forward.output(X, Y.begin());
+                  return Y[0];
+              }));
+    }
+
+    // The smallest hidden layer of continuous MVNs learning the function
+    for (int hidden = 2; hidden <= max_hidden; hidden *= 2) {
+        vector<int> sizes(3), k_values(2);
+
+        sizes[0] = n;
+        sizes[1] = hidden;
+        sizes[2] = 1;
+
+        k_values[0] = 0;
+        k_values[1] = K;
+
+        srand(1);
+
+        mlmvn net(sizes, k_values);
+        int net_epochs = learn(net, network, output_match<K>());
+
+        if (!net_epochs && hidden < max_hidden)
+            continue;
+
+        mlmvn_forward forward(net);
+        cvector Y(1);
+
+        print(function, "MLMVN " + to_string(n) + "-" + to_string(hidden) + "-1", net_epochs,
+              hidden * (n + 1) + hidden + 1,
+              inference_ns(network, [&](const cvector &X) {
+                  forward.output(X, Y.begin());
+                  return Y[0];
+              }));
+        break;
+    }
+}
+
+int main()
+{
+    cout << setw(12) << "function" << setw(18) << "model" << setw(10) << "epochs"
+         << setw(10) << "weights" << setw(12) << "bytes" << setw(12) << "ns/sample" << endl;
+
+    for (int n = 2; n <= 6; ++n)
+        compare<2>("parity " + to_string(n), n);
+
+    for (int n = 2; n <= 4; ++n)
+        compare<3>("mod3 sum " + to_string(n), n);
+
+    return 0;
+}
@@ -0,0 +1,223 @@
+/*
+ * Learning quality and speed of the double and float builds. This file is
+ * built twice: bench_precision links mvn, bench_precision_float links
+ * mvn_float (KLOGIC_FLOAT), so their outputs can be compared line by line:
+ *
+ *  - post_function: single MVN, 3-valued max(x1, x2) as in
+ *    test/post_function.cc, epochs until all samples hit
+ *  - three_classes: 2-2-1 continuous network from test/three_classes.cc,
+ *    epochs until MSE of output phases is under tolerance
+ *  - a bigger network on random data: learning and inference samples/s,
+ *    hits after a few epochs
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <cstdlib>
+#include "mvn.h"
+#include "mlmvn.h"
+#include "learning.h"
+#include "transforms.h"
+#include "kernels.h"
+
+using namespace std;
+using namespace klogic;
+using namespace klogic::learning;
+
+typedef chrono::steady_clock bench_clock;
+
+double seconds_since(bench_clock::time_point start)
+{
+    return chrono::duration<double>(bench_clock::now() - start).count();
+}
+
+const int max_epochs = 100000;
+
+// ------------------
+
+const int post_samples[][3] = {
+    { 0, 0, 0 }, { 0, 1, 1 }, { 0, 2, 2 },
+    { 1, 0, 1 }, { 1, 1, 1 }, { 1, 2, 2 },
+    { 2, 0, 2 }, { 2, 1, 2 }, { 2, 2, 2 }
+};
+
+void post_function()
+{
+    srand(1);
+
+    mvn neuron(3, 2);
+    teacher<mvn> t(neuron);
+
+    for (int i = 0; i < 9; ++i) {
+        vector<int> input(post_samples[i], post_samples[i] + 2);
+
+        t.add_sample(transform::discrete<3, cmplx>(input, post_samples[i][2]));
+    }
+
+    int epochs = 0, hits = 0;
+
+    while (hits < t.samples_count() && epochs < max_epochs) {
+        t.learn_run();
+        hits = t.hits<single_discrete_match<3> >();
+        ++epochs;
+    }
+
+    cout << setw(16) << "post_function" << setw(10) << epochs
+         << setw(14) << hits << "/" << t.samples_count() << endl;
+}
+
+// ------------------
+
+const double three_samples[][3] = {
+    { 4.23, 2.10, 0.76 },
+    { 5.34, 1.24, 2.56 },
+    { 2.10, 0.00, 5.35 }
+};
+
+const double TOLERANCE = 0.05;
+
+double phase_error(const learning::sample<cvector> &s, const cvector &actual)
+{
+    return fabs(phase(s.desired[0]) - phase(actual[0]));
+}
+
+struct tolerance_picker {
+    bool operator()(const learning::sample<cvector> &s, const cvector &actual) const {
+        return phase_error(s, actual) > TOLERANCE;
+    }
+};
+
+struct square_error {
+    double operator()(const learning::sample<cvector> &s, const cvector &actual) const {
+        double err = phase_error(s, actual);
+
+        return err * err;
+    }
+};
+
+void three_classes()
+{
+    vector<int> sizes(3), k_values(2, 0);
+
+    sizes[0] = 2;
+    sizes[1] = 2;
+    sizes[2] = 1;
+
+    mlmvn net(sizes, k_values);
+
+    // Initial weights of the example
+    for (size_t layer = 0; layer < 2; ++layer) {
+        for (size_t i = 0; i < net.layer_size(layer); ++i) {
+            weights_view w = net.neuron(i, layer).weights_vector();
+
+            w[0] = cmplx(0.23, -0.38);
+            w[1] = cmplx(0.19, -0.46);
+            w[2] = cmplx(0.36, -0.33);
+        }
+    }
+
+    teacher<mlmvn> t(net);
+
+    for (int i = 0; i < 3; ++i) {
+        vector<double> input(three_samples[i], three_samples[i] + 2);
+        vector<double> desired(three_samples[i] + 2, three_samples[i] + 3);
+
+        t.add_sample(transform::continuous<cvector>(input, desired));
+    }
+
+    int epochs = 0;
+    double mse = t.mse<square_error>();
+
+    while (mse >= TOLERANCE * TOLERANCE && epochs < max_epochs) {
+        t.learn_run<tolerance_picker>();
+        mse = t.mse<square_error>();
+        ++epochs;
+    }
+
+    cout << setw(16) << "three_classes" << setw(10) << epochs << setw(14) << mse << endl;
+}
+
+// ------------------
+
+// Desired output matches if its sector is the same
+struct sector_match {
+    bool operator()(const cvector &output, const cvector &desired) const {
+        return sector_number(output_k, output[0]) == sector_number(output_k, desired[0]);
+    }
+
+    static const int output_k = 8;
+};
+
+void throughput()
+{
+    const int inputs = 64, hidden = 128, nsamples = 2048, epochs = 5, rounds = 20;
+
+    srand(1);
+
+    vector<int> sizes(3), k_values(2);
+
+    sizes[0] = inputs;
+    sizes[1] = hidden;
+    sizes[2] = 1;
+
+    k_values[0] = 0;
+    k_values[1] = sector_match::output_k;
+
+    mlmvn net(sizes, k_values);
+    vector<learning::sample<cvector> > samples;
+
+    for (int s = 0; s < nsamples; ++s) {
+        cvector input(inputs);
+
+        for (int i = 0; i < inputs; ++i)
+            input[i] = polar(scalar(1), scalar(TWOPI * rand() / (RAND_MAX + 1.0)));
+
+        // Class depends on the first inputs, so there is something to learn
+        int c = int(phase(input[0]) / TWOPI * sector_match::output_k);
+
+        samples.push_back(learning::sample<cvector>(input, cvector(1, epsilon(c, sector_match::output_k))));
+    }
+
+    teacher<mlmvn> t(net, samples);
+
+    bench_clock::time_point start = bench_clock::now();
+
+    for (int e = 0; e < epochs; ++e)
+        t.learn_run();
+
+    double t_learn = seconds_since(start);
+
+    mlmvn_workspace ws(net);
+    cmplx sum(0);
+
+    start = bench_clock::now();
+
+    for (int r = 0; r < rounds; ++r) {
+        for (int s = 0; s < nsamples; ++s)
+            sum += net.forward(samples[s].input, ws)[0];
+    }
+
+    double t_infer = seconds_since(start);
+
+    cout << setw(16) << "64-128-1" << setw(10) << epochs
+         << setw(14) << t.hits<sector_match>() << "/" << nsamples
+         << setw(16) << setprecision(0) << fixed << nsamples * epochs / t_learn
+         << setw(16) << nsamples * rounds / t_infer
+         << setprecision(6) << (abs(sum) > 1e300 ? "!" : "") << endl;
+}
+
+int main()
+{
+    cout << "scalar: " << (sizeof(scalar) == sizeof(float) ? "float" : "double")
+         << ", kernels: " << kernels::dot_name() << endl;
+
+    cout << setw(16) << "problem" << setw(10) << "epochs" << setw(14) << "result"
+         << setw(17) << "learn, 1/s" << setw(16) << "infer, 1/s" << endl;
+
+    post_function();
+    three_classes();
+    throughput();
+
+    return 0;
+}
@@ -0,0 +1,120 @@
+/*
+ * Inference of a discrete network: mlmvn with a workspace against
+ * quantized_mlmvn with 16- and 8-bit weights. Reports time per sample,
+ * weights memory and how often quantized outputs match mlmvn ones
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <cstdlib>
+#include "mlmvn.h"
+#include "quantized.h"
+
+using namespace std;
+using namespace klogic;
+
+typedef chrono::steady_clock bench_clock;
+
+const int nsamples = 1 << 10;
+const int rounds   = 5;
+
+double seconds_since(bench_clock::time_point start)
+{
+    return chrono::duration<double>(bench_clock::now() - start).count();
+}
+
+// Output sectors of all samples, all rounds give the same ones
+template<typename Weight>
+void run_quantized(const char *name, const mlmvn &net, const vector<vector<int> > &inputs,
+                   const vector<vector<int> > &expected, double t_double)
+{
+    quantized_mlmvn<Weight> q(net);
+    quantized_workspace<Weight> ws(q);
+    vector<int> out(q.output_size());
+    size_t matches = 0, total = 0;
+
+    bench_clock::time_point start = bench_clock::now();
+
+    for (int round = 0; round < rounds; ++round) {
+        for (int s = 0; s < nsamples; ++s) {
+            q.output(inputs[s].data(), out.data(), ws);
+
+            if (round == 0) {
+                for (size_t i = 0; i < out.size(); ++i, ++total)
+                    matches += out[i] == expected[s][i];
+            }
+        }
+    }
+
+    double t = seconds_since(start);
+
+    cout << setw(10) << name << setw(14) << t * 1e6 / (double(nsamples) * rounds)
+         << setw(10) << setprecision(3) << t_double / t << setw(14) << q.weights_bytes()
+         << setw(12) << 100.0 * matches / total << "%" << setprecision(6) << endl;
+}
+
+void run(const vector<int> &sizes, int k)
+{
+    vector<int> k_values(sizes.size() - 1, k);
+    mlmvn net(sizes, k_values);
+    mlmvn_workspace ws(net);
+
+    vector<vector<int> > inputs(nsamples);
+    vector<cvector> X(nsamples);
+    vector<vector<int> > expected(nsamples);
+
+    for (int s = 0; s < nsamples; ++s) {
+        for (int i = 0; i < sizes[0]; ++i) {
+            inputs[s].push_back(rand() % k);
+            X[s].push_back(epsilon(inputs[s].back(), k));
+        }
+    }
+
+    bench_clock::time_point start = bench_clock::now();
+
+    for (int round = 0; round < rounds; ++round) {
+        for (int s = 0; s < nsamples; ++s) {
+            const cvector &out = net.forward(X[s], ws);
+
+            if (round == 0)
+                expected[s] = to_sectors(k, out);
+        }
+    }
+
+    double t_double = seconds_since(start);
+
+    size_t n_weights = 0;
+
+    for (size_t layer = 0; layer < net.layers_count(); ++layer)
+        n_weights += net.layer_size(layer) * (net.layer_inputs(layer) + 1);
+
+    cout << "network";
+
+    for (size_t i = 0; i < sizes.size(); ++i)
+        cout << (i ? "-" : " ") << sizes[i];
+
+    cout << ", k = " << k << endl;
+
+    cout << setw(10) << "weights" << setw(14) << "us/sample" << setw(10) << "speedup"
+         << setw(14) << "bytes" << setw(13) << "match" << endl;
+
+    cout << setw(10) << "double" << setw(14) << t_double * 1e6 / (double(nsamples) * rounds)
+         << setw(10) << 1 << setw(14) << n_weights * sizeof(cmplx) << setw(13) << "" << endl;
+
+    run_quantized<int16_t>("int16", net, inputs, expected, t_double);
+    run_quantized<int8_t>("int8", net, inputs, expected, t_double);
+
+    cout << endl;
+}
+
+int main()
+{
+    srand(1);
+
+    run(vector<int>{ 64, 64, 8 }, 4);
+    run(vector<int>{ 256, 512, 16 }, 16);
+    run(vector<int>{ 1024, 1024, 64 }, 8);
+
+    return 0;
+}
@@ -0,0 +1,119 @@
+/*
+ * Speed and accuracy of pruned networks: for several sparsity levels
+ * weights of smallest magnitude are pruned in every layer, then the
+ * dense forward pass of the original network is compared with
+ * sparse_mlmvn. Accuracy is the share of output sectors that stay the
+ * same as the unpruned network gives. Weights have heavy-tailed
+ * magnitudes (log-normal), as trained networks often have
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <random>
+#include "mlmvn.h"
+#include "sparse.h"
+#include "quantized.h"
+
+using namespace std;
+using namespace klogic;
+
+typedef chrono::steady_clock bench_clock;
+
+const int nsamples = 512;
+const int output_k = 16;
+
+double seconds_since(bench_clock::time_point start)
+{
+    return chrono::duration<double>(bench_clock::now() - start).count();
+}
+
+int main()
+{
+    vector<int> sizes(4), k_values(3, 0);
+
+    sizes[0] = 256;
+    sizes[1] = 1024;
+    sizes[2] = 1024;
+    sizes[3] = 16;
+
+    k_values[2] = output_k;
+
+    mlmvn net(sizes, k_values);
+    mt19937 random(1);
+    lognormal_distribution<double> magnitude(-3.0, 2.5);
+    uniform_real_distribution<double> angle(0, TWOPI);
+
+    for (size_t layer = 0; layer < net.layers_count(); ++layer) {
+        cmplx *w = net.layer_weights(layer);
+        size_t n = net.layer_size(layer) * (net.layer_inputs(layer) + 1);
+
+        for (size_t i = 0; i < n; ++i)
+            w[i] = polar(scalar(magnitude(random)), scalar(angle(random)));
+    }
+
+    vector<cvector> X(nsamples, cvector(sizes[0]));
+    vector<vector<int> > expected(nsamples);
+
+    for (int s = 0; s < nsamples; ++s) {
+        for (int i = 0; i < sizes[0]; ++i)
+            X[s][i] = polar(scalar(1), scalar(angle(random)));
+
+        expected[s] = to_sectors(output_k, net.output(X[s]));
+    }
+
+    // Dense forward pass doesn't depend on zeros
+    mlmvn_workspace ws(net);
+    bench_clock::time_point start = bench_clock::now();
+
+    for (int s = 0; s < nsamples; ++s)
+        net.forward(X[s], ws);
+
+    double dense_time = seconds_since(start) / nsamples;
+
+    cout << "Network 256-1024-1024-16 (k = " << output_k << " output), " << nsamples
+         << " samples, dense forward " << fixed << setprecision(1) << dense_time * 1e6
+         << " us" << endl << endl;
+    cout << setw(10) << "sparsity" << setw(10) << "density" << setw(14) << "sparse, us"
+         << setw(10) << "speedup" << setw(12) << "same, %" << endl;
+
+    double levels[] = { 0.0, 0.5, 0.75, 0.9, 0.95, 0.98 };
+
+    for (size_t l = 0; l < sizeof(levels) / sizeof(levels[0]); ++l) {
+        mlmvn pruned(net);
+        vector<double> thresholds;
+
+        for (size_t layer = 0; layer < net.layers_count(); ++layer)
+            thresholds.push_back(magnitude_quantile(net, layer, levels[l]));
+
+        prune(pruned, thresholds);
+
+        sparse_mlmvn sparse(pruned);
+        sparse_workspace sws(sparse);
+        cvector out(sparse.output_size());
+        size_t same = 0;
+
+        start = bench_clock::now();
+
+        for (int s = 0; s < nsamples; ++s)
+            sparse.output(X[s], out.data(), sws);
+
+        double sparse_time = seconds_since(start) / nsamples;
+
+        for (int s = 0; s < nsamples; ++s) {
+            sparse.output(X[s], out.data(), sws);
+
+            vector<int> got = to_sectors(output_k, out);
+
+            for (size_t i = 0; i < got.size(); ++i)
+                same += got[i] == expected[s][i];
+        }
+
+        cout << setw(10) << setprecision(2) << levels[l] << setw(10) << sparse.density()
+             << setw(14) << setprecision(1) << sparse_time * 1e6 << setw(10) << setprecision(2)
+             << dense_time / sparse_time << setw(12) << setprecision(1)
+             << 100.0 * same / (nsamples * sparse.output_size()) << endl;
+    }
+
+    return 0;
+}
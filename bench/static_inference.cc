@@ -0,0 +1,92 @@
+/*
+ * Per-sample inference time of small networks: mlmvn with a workspace
+ * against static_mlmvn with the same weights
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <cstdlib>
+#include "mlmvn.h"
+#include "static_mlmvn.h"
+
+using namespace std;
+using namespace klogic;
+
+typedef chrono::steady_clock bench_clock;
+
+const int nsamples = 1 << 12;
+const int rounds   = 100;
+
+double seconds_since(bench_clock::time_point start)
+{
+    return chrono::duration<double>(bench_clock::now() - start).count();
+}
+
+template<typename Static>
+void run(const char *name, const vector<int> &sizes, const vector<int> &k_values)
+{
+    mlmvn net(sizes, k_values);
+    Static fixed(net);
+    mlmvn_workspace ws(net);
+
+    vector<typename Static::input_type> X(nsamples);
+
+    for (int s = 0; s < nsamples; ++s) {
+        for (int i = 0; i < Static::inputs; ++i)
+            X[s][i] = polar(1.0, TWOPI * rand() / RAND_MAX);
+    }
+
+    // Sum of outputs keeps compiler from dropping the work
+    cmplx sum_dynamic(0), sum_static(0);
+    double max_diff = 0;
+
+    bench_clock::time_point start = bench_clock::now();
+
+    for (int round = 0; round < rounds; ++round) {
+        for (int s = 0; s < nsamples; ++s)
+            sum_dynamic += net.forward(const_cspan(X[s].data(), X[s].size()), ws)[0];
+    }
+
+    double t_dynamic = seconds_since(start);
+
+    start = bench_clock::now();
+
+    for (int round = 0; round < rounds; ++round) {
+        for (int s = 0; s < nsamples; ++s)
+            sum_static += fixed.output(X[s])[0];
+    }
+
+    double t_static = seconds_since(start);
+
+    for (int s = 0; s < nsamples; ++s) {
+        const cvector &a = net.forward(const_cspan(X[s].data(), X[s].size()), ws);
+        typename Static::output_type b = fixed.output(X[s]);
+
+        for (int i = 0; i < Static::outputs; ++i)
+            max_diff = max(max_diff, abs(a[i] - b[i]));
+    }
+
+    double per_sample = 1e9 / (double(nsamples) * rounds);
+
+    cout << setw(16) << name << setw(14) << t_dynamic * per_sample << setw(14) << t_static * per_sample
+         << setw(10) << setprecision(3) << t_dynamic / t_static << setw(12) << max_diff
+         << setprecision(6) << (abs(sum_dynamic - sum_static) > 1e300 ? "!" : "") << endl;
+}
+
+int main()
+{
+    cout << setw(16) << "network" << setw(14) << "mlmvn, ns" << setw(14) << "static, ns"
+         << setw(10) << "speedup" << setw(12) << "max diff" << endl;
+
+    run<static_mlmvn<2, layer<2, 0>, layer<1, 0> > >("2-2-1, k=0",
+        { 2, 2, 1 }, { 0, 0 });
+
+    run<static_mlmvn<4, layer<8, 0>, layer<2, 16> > >("4-8-2, k=0,16",
+        { 4, 8, 2 }, { 0, 16 });
+
+    run<static_mlmvn<16, layer<16, 0>, layer<8, 0>, layer<4, 4> > >("16-16-8-4",
+        { 16, 16, 8, 4 }, { 0, 0, 4 });
+
+    return 0;
+}
@@ -0,0 +1,92 @@
+/*
+ * Streaming learning from a dataset file: time to decode all samples,
+ * epoch time with samples in memory and epoch time of streaming_teacher.
+ * With prefetching the streaming epoch should take about max(decode,
+ * in-memory) rather than their sum
+ */
+
+#include <iostream>
+#include <chrono>
+#include <cstdlib>
+#include <cstdio>
+#include "mlmvn.h"
+#include "learning.h"
+#include "streaming.h"
+
+using namespace std;
+using namespace klogic;
+using namespace klogic::learning;
+
+typedef chrono::steady_clock bench_clock;
+typedef sample<cvector> sample_type;
+
+const int nsamples   = 16384;
+const int chunk_size = 1024;
+
+double seconds_since(bench_clock::time_point start)
+{
+    return chrono::duration<double>(bench_clock::now() - start).count();
+}
+
+int main()
+{
+    vector<int> sizes(3), k_values(2, 0);
+
+    sizes[0] = 64;
+    sizes[1] = 64;
+    sizes[2] = 4;
+
+    const char *path = "bench_streaming.mvn";
+
+    {
+        dataset_writer writer(path, PHASE, sizes[0], sizes[2]);
+        vector<double> phases(sizes[0] + sizes[2]);
+
+        for (int i = 0; i < nsamples; ++i) {
+            for (size_t j = 0; j < phases.size(); ++j)
+                phases[j] = TWOPI * rand() / (RAND_MAX + 1.0);
+
+            writer.add_phases(phases.data());
+        }
+    }
+
+    mapped_dataset file(path);
+    dataset_source<cvector> source(file);
+
+    cout << "Network 64-64-4, " << nsamples << " samples (PHASE encoding), chunks of "
+         << chunk_size << endl << endl;
+
+    // Decoding only
+    bench_clock::time_point start = bench_clock::now();
+    vector<sample_type> all;
+
+    source.rewind();
+    while (source.read(all, chunk_size))
+        ;
+
+    cout << "decode:    " << seconds_since(start) << " s" << endl;
+
+    // Learning with samples in memory
+    mlmvn in_memory(sizes, k_values);
+    mlmvn streamed(in_memory);
+
+    teacher<mlmvn> t(in_memory, sample_span<sample_type>(all));
+
+    start = bench_clock::now();
+    t.learn_run();
+    cout << "in memory: " << seconds_since(start) << " s" << endl;
+
+    // The same epoch streamed from file
+    streaming_teacher<mlmvn> st(streamed, source, chunk_size);
+
+    start = bench_clock::now();
+    st.learn_run();
+    cout << "streaming: " << seconds_since(start) << " s" << endl;
+
+    cout << endl << "same weights: "
+         << (in_memory.output(all[0].input) == streamed.output(all[0].input) ? "yes" : "no") << endl;
+
+    remove(path);
+
+    return 0;
+}
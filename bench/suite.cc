@@ -0,0 +1,352 @@
+/*
+ * Benchmark suite for throughput regressions between releases. Measures
+ * mvn::weighted_sum and mvn::learn for several input widths, and
+ * mlmvn_forward::output, mlmvn::learn, error backpropagation
+ * (calculate_errors) and teacher epochs (learn_run, mse) for several
+ * topologies, with continuous and discrete neurons.
+ *
+ * Usage: bench_suite [results.json [baseline.json [tolerance]]]
+ *
+ * Results are written as JSON to results.json or stdout, one result per
+ * line. With a baseline file from an earlier run, results slower than the
+ * baseline by more than tolerance (0.1 by default, i.e. 10%) are listed
+ * and the exit code is 1. Compare runs made on a quiet machine
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <map>
+#include <chrono>
+#include <cstdlib>
+#include "mvn.h"
+#include "mlmvn.h"
+#include "learning.h"
+#include "kernels.h"
+
+using namespace std;
+using namespace klogic;
+
+typedef chrono::steady_clock bench_clock;
+typedef learning::sample<cvector> sample_type;
+
+// Each measurement is the best of `rounds` rounds repeating the
+// operation at least min_seconds long, which filters out most noise
+const int    rounds      = 5;
+const double min_seconds = 0.03;
+
+// Default slowdown reported as regression
+const double TOLERANCE = 0.10;
+
+// Samples per teacher epoch
+const int epoch_samples = 256;
+
+double seconds_since(bench_clock::time_point start)
+{
+    return chrono::duration<double>(bench_clock::now() - start).count();
+}
+
+cvector random_phases(int n)
+{
+    cvector v(n);
+
+    for (int i = 0; i < n; ++i)
+        v[i] = polar(scalar(1), scalar(TWOPI * rand() / RAND_MAX));
+
+    return v;
+}
+
+// Random k-th roots of unity, or random phases if k is 0
+cvector random_values(int n, int k)
+{
+    if (k == 0)
+        return random_phases(n);
+
+    cvector v(n);
+
+    for (int i = 0; i < n; ++i)
+        v[i] = epsilon(rand() % k, k);
+
+    return v;
+}
+
+// Access to protected parts measured by the suite
+class neuron_probe : public mvn {
+public:
+    neuron_probe(int k, int N) : mvn(k, N) {}
+
+    using mvn::weighted_sum;
+};
+
+class network_probe : public mlmvn {
+public:
+    network_probe(const vector<int> &sizes, const vector<int> &k_values)
+        : mlmvn(sizes, k_values) {}
+
+    void backward(const cvector &errors, mlmvn_workspace &ws) const {
+        calculate_errors(errors, ws);
+    }
+};
+
+class square_error {
+public:
+    double operator()(const sample_type &sample, const cvector &actual) const {
+        double result = 0;
+
+        for (size_t i = 0; i < actual.size(); ++i)
+            result += norm(sample.desired[i] - actual[i]);
+
+        return result;
+    }
+};
+
+// ------------------
+
+struct result {
+    string benchmark, topology;
+    int k;
+    long iterations;
+    double seconds;
+
+    double per_second() const { return iterations / seconds; }
+
+    // Identifies the same measurement in another run
+    string id() const {
+        ostringstream s;
+
+        s << benchmark << ' ' << topology << ' ' << k;
+
+        return s.str();
+    }
+};
+
+// Run op in rounds until min_seconds pass. Each call of op counts as
+// per_call operations (e.g. samples of an epoch)
+template<typename Operation>
+result measure(const string &benchmark, const string &topology, int k, Operation op,
+               long per_call = 1)
+{
+    result r = { benchmark, topology, k, 0, 0.0 };
+
+    // Warm up caches and lazily built tables
+    op();
+
+    for (int round = 0; round < rounds; ++round) {
+        bench_clock::time_point start = bench_clock::now();
+        long iterations = 0;
+
+        do {
+            op();
+            iterations += per_call;
+        } while (seconds_since(start) < min_seconds);
+
+        double seconds = seconds_since(start);
+
+        if (round == 0 || iterations / seconds > r.per_second()) {
+            r.iterations = iterations;
+            r.seconds    = seconds;
+        }
+    }
+
+    cerr << setw(24) << left << benchmark << setw(20) << topology << right << setw(4) << k
+         << setw(16) << fixed << setprecision(0) << r.per_second() << "/s" << endl;
+
+    return r;
+}
+
+string topology_name(const vector<int> &sizes)
+{
+    ostringstream s;
+
+    for (size_t i = 0; i < sizes.size(); ++i)
+        s << (i ? "-" : "") << sizes[i];
+
+    return s.str();
+}
+
+// ------------------
+
+void neuron_benchmarks(int inputs, int k, vector<result> &results)
+{
+    neuron_probe neuron(k, inputs);
+    cvector X = random_values(inputs, k);
+    cmplx error = random_phases(1)[0] - neuron.output(X);
+    string topology = topology_name(vector<int>(1, inputs));
+    volatile scalar sink = 0;
+
+    results.push_back(measure("mvn::weighted_sum", topology, k, [&]() {
+        sink = sink + neuron.weighted_sum(X).real();
+    }));
+
+    results.push_back(measure("mvn::learn", topology, k, [&]() {
+        neuron.learn(X, error * scalar(1e-3));
+    }));
+}
+
+void network_benchmarks(const vector<int> &sizes, int k, vector<result> &results)
+{
+    vector<int> k_values(sizes.size() - 1, k);
+    network_probe net(sizes, k_values);
+    string topology = topology_name(sizes);
+
+    vector<sample_type> samples;
+
+    for (int s = 0; s < epoch_samples; ++s)
+        samples.push_back(sample_type(random_values(sizes.front(), k), random_values(sizes.back(), k)));
+
+    const cvector &X = samples[0].input;
+    cvector Y(net.output_layer_size());
+    cvector error = random_phases(net.output_layer_size());
+    mlmvn_forward forward(net);
+    mlmvn_workspace ws(net);
+
+    results.push_back(measure("mlmvn_forward::output", topology, k, [&]() {
+        forward.output(X, Y.begin());
+    }));
+
+    results.push_back(measure("mlmvn::learn", topology, k, [&]() {
+        net.learn(X, error, 1e-3, ws);
+    }));
+
+    net.update_reciprocals();
+    net.forward(X, ws);
+
+    results.push_back(measure("calculate_errors", topology, k, [&]() {
+        net.backward(error, ws);
+    }));
+
+    // Epochs are counted in samples
+    learning::teacher<mlmvn> teacher(net, samples);
+
+    results.push_back(measure("teacher::learn_run", topology, k, [&]() {
+        teacher.learn_run();
+    }, epoch_samples));
+
+    results.push_back(measure("teacher::mse", topology, k, [&]() {
+        teacher.mse(square_error());
+    }, epoch_samples));
+}
+
+// ------------------
+
+void write_json(ostream &out, const vector<result> &results)
+{
+    out << fixed << "{" << endl;
+    out << "  \"scalar\": \"" << (sizeof(scalar) == sizeof(float) ? "float" : "double") << "\"," << endl;
+    out << "  \"kernels\": \"" << kernels::dot_name() << "\"," << endl;
+    out << "  \"threads\": " << parallel_options().thread_count() << "," << endl;
+    out << "  \"results\": [" << endl;
+
+    for (size_t i = 0; i < results.size(); ++i) {
+        const result &r = results[i];
+
+        out << "    {\"benchmark\": \"" << r.benchmark << "\", \"topology\": \"" << r.topology
+            << "\", \"k\": " << r.k << ", \"iterations\": " << r.iterations
+            << ", \"seconds\": " << setprecision(6) << r.seconds
+            << ", \"per_second\": " << setprecision(1) << r.per_second() << "}"
+            << (i + 1 < results.size() ? "," : "") << endl;
+    }
+
+    out << "  ]" << endl << "}" << endl;
+}
+
+// Value of "name": in a result line written by write_json()
+string field(const string &line, const string &name)
+{
+    string key = "\"" + name + "\": ";
+    size_t pos = line.find(key);
+
+    if (pos == string::npos)
+        return string();
+
+    pos += key.size();
+
+    if (line[pos] == '"')
+        return line.substr(pos + 1, line.find('"', pos + 1) - pos - 1);
+
+    return line.substr(pos, line.find_first_of(",}", pos) - pos);
+}
+
+// Throughput by result id from a file written by write_json()
+map<string, double> read_baseline(const char *path)
+{
+    ifstream in(path);
+    map<string, double> baseline;
+    string line;
+
+    if (!in)
+        throw runtime_error(string("bench_suite: can't read ") + path);
+
+    while (getline(in, line)) {
+        if (field(line, "benchmark").empty())
+            continue;
+
+        result r = { field(line, "benchmark"), field(line, "topology"),
+                     atoi(field(line, "k").c_str()), 0, 0.0 };
+
+        baseline[r.id()] = atof(field(line, "per_second").c_str());
+    }
+
+    return baseline;
+}
+
+int main(int argc, char *argv[])
+{
+    srand(1);
+
+    vector<result> results;
+
+    int widths[] = { 16, 256, 4096 };
+    int k_values[] = { 0, 16 };
+
+    for (int i = 0; i < 3; ++i) {
+        for (int j = 0; j < 2; ++j)
+            neuron_benchmarks(widths[i], k_values[j], results);
+    }
+
+    // Networks of one to three layers
+    vector<vector<int> > topologies;
+
+    int small[] = { 16, 16, 4 }, medium[] = { 64, 256, 256, 16 }, wide[] = { 1024, 512, 16 };
+
+    topologies.push_back(vector<int>(small, small + 3));
+    topologies.push_back(vector<int>(medium, medium + 4));
+    topologies.push_back(vector<int>(wide, wide + 3));
+    topologies.push_back(vector<int>(1, 256));
+    topologies.back().push_back(8);
+
+    for (size_t i = 0; i < topologies.size(); ++i) {
+        for (int j = 0; j < 2; ++j)
+            network_benchmarks(topologies[i], k_values[j], results);
+    }
+
+    if (argc > 1) {
+        ofstream out(argv[1]);
+
+        write_json(out, results);
+    } else {
+        write_json(cout, results);
+    }
+
+    if (argc > 2) {
+        map<string, double> baseline = read_baseline(argv[2]);
+        double tolerance = argc > 3 ? atof(argv[3]) : TOLERANCE;
+        int regressions = 0;
+
+        for (size_t i = 0; i < results.size(); ++i) {
+            map<string, double>::const_iterator b = baseline.find(results[i].id());
+
+            if (b == baseline.end() || results[i].per_second() >= b->second * (1 - tolerance))
+                continue;
+
+            cerr << "regression: " << results[i].id() << ": " << results[i].per_second()
+                 << "/s, baseline " << b->second << "/s" << endl;
+            ++regressions;
+        }
+
+        return regressions ? 1 : 0;
+    }
+
+    return 0;
+}
@@ -0,0 +1,90 @@
+/*
+ * Where learning time goes: per-layer time of forward pass, error
+ * backpropagation and weights correction, with counts of weighted sums,
+ * divisions and corrections, reported by the teacher's epoch callback.
+ * Counters are zero unless the library is configured with
+ * -DMVN_PROFILE=ON (KLOGIC_PROFILE)
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+#include "mlmvn.h"
+#include "learning.h"
+
+using namespace std;
+using namespace klogic;
+
+typedef learning::sample<cvector> sample_type;
+
+const int nsamples = 1024;
+const int epochs   = 3;
+
+cvector random_phases(int n)
+{
+    cvector v(n);
+
+    for (int i = 0; i < n; ++i)
+        v[i] = polar(scalar(1), scalar(TWOPI * rand() / RAND_MAX));
+
+    return v;
+}
+
+// Skips samples whose first output is already close
+class far_picker {
+public:
+    bool operator()(const sample_type &sample, const cvector &actual) const {
+        return abs(sample.desired[0] - actual[0]) > 0.5;
+    }
+};
+
+void report(const learning::epoch_report &epoch)
+{
+    const learning_profile &p = epoch.profile;
+
+    cout << "Epoch " << epoch.epoch << ": " << epoch.samples << " samples, " << fixed
+         << setprecision(3) << epoch.seconds << " s, " << p.learn_calls << " learned, "
+         << p.skipped_samples << " skipped" << endl;
+
+    cout << setw(8) << "layer" << setw(12) << "forward, s" << setw(12) << "backward, s"
+         << setw(12) << "update, s" << setw(16) << "weighted sums" << setw(14) << "divisions"
+         << setw(14) << "corrections" << endl;
+
+    for (size_t layer = 0; layer < p.layers.size(); ++layer) {
+        const layer_profile &l = p.layers[layer];
+
+        cout << setw(8) << layer + 1 << setw(12) << l.forward_seconds << setw(12) << l.backward_seconds
+             << setw(12) << l.update_seconds << setw(16) << l.weighted_sums << setw(14) << l.divisions
+             << setw(14) << l.corrections << endl;
+    }
+
+    cout << endl;
+}
+
+int main()
+{
+    vector<int> sizes(4), k_values(3, 0);
+
+    sizes[0] = 64;
+    sizes[1] = 256;
+    sizes[2] = 256;
+    sizes[3] = 8;
+
+    mlmvn net(sizes, k_values);
+    vector<sample_type> samples;
+
+    for (int i = 0; i < nsamples; ++i)
+        samples.push_back(sample_type(random_phases(sizes[0]), random_phases(sizes[3])));
+
+    cout << "Network 64-256-256-8, " << nsamples << " samples, instrumentation "
+         << (PROFILING ? "on" : "off (configure with -DMVN_PROFILE=ON)") << endl << endl;
+
+    learning::teacher<mlmvn> teacher(net, samples);
+
+    teacher.set_epoch_callback(report);
+
+    for (int epoch = 0; epoch < epochs; ++epoch)
+        teacher.learn_run<far_picker>();
+
+    return 0;
+}
@@ -0,0 +1,89 @@
+/*
+ * Compare complex dot product kernels used by mvn::weighted_sum against
+ * the original iterator loop for input widths 8..4096
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <cstdlib>
+#include "kernels.h"
+
+using namespace std;
+using namespace klogic;
+
+// The loop mvn::weighted_sum used before kernels::dot
+cmplx iterator_loop(const cmplx *w, const cmplx *x, size_t n)
+{
+    const cmplx *wi = w, *xi = x, *wend = w + n;
+    cmplx z = 0;
+
+    while (wi != wend)
+        z += (*wi++) * (*xi++);
+
+    return z;
+}
+
+cvector random_vector(size_t n)
+{
+    cvector v(n);
+
+    for (size_t i = 0; i < n; ++i)
+        v[i] = cmplx(double(rand()) / RAND_MAX - 0.5, double(rand()) / RAND_MAX - 0.5);
+
+    return v;
+}
+
+// Nanoseconds per call
+double measure(kernels::dot_function f, const cvector &w, const cvector &x)
+{
+    typedef chrono::steady_clock clock;
+
+    volatile double sink = 0;
+    size_t calls = 0;
+
+    clock::time_point start = clock::now(), now;
+
+    do {
+        for (int i = 0; i < 256; ++i)
+            sink = sink + f(&w[0], &x[0], w.size()).real();
+
+        calls += 256;
+        now = clock::now();
+    } while (now - start < chrono::milliseconds(50));
+
+    return chrono::duration<double, nano>(now - start).count() / calls;
+}
+
+int main()
+{
+    vector<kernels::dot_kernel> candidates = kernels::available_dot_kernels();
+
+    cout << "dot() uses: " << kernels::dot_name() << endl << endl;
+
+    cout << setw(6) << "width" << setw(12) << "iterator";
+    for (size_t i = 0; i < candidates.size(); ++i)
+        cout << setw(12) << candidates[i].name;
+    cout << setw(12) << "speedup" << "   (ns per call)" << endl;
+
+    for (size_t n = 8; n <= 4096; n *= 2) {
+        cvector w = random_vector(n), x = random_vector(n);
+
+        double base = measure(&iterator_loop, w, x), best = base;
+
+        cout << setw(6) << n << fixed << setprecision(1) << setw(12) << base;
+
+        for (size_t i = 0; i < candidates.size(); ++i) {
+            double t = measure(candidates[i].function, w, x);
+
+            if (t < best)
+                best = t;
+
+            cout << setw(12) << t;
+        }
+
+        cout << setw(11) << setprecision(2) << base / best << 'x' << endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,174 @@
+#include <algorithm>
+#include <stdexcept>
+#include "classifier.h"
+#include "kernels.h"
+
+using namespace std;
+
+namespace {
+    // Samples per block in decode_winner(). Scores of a block stay in
+    // arrays on the stack
+    const size_t WINNER_BLOCK = 64;
+
+    // Score of zero outputs, below any cosine
+    const klogic::scalar NO_SCORE = -2;
+}
+
+const int klogic::class_decoder::REJECTED;
+
+klogic::class_decoder klogic::class_decoder::sectors(int k, const std::vector<int> &labels)
+{
+    if (k <= 0 || labels.size() != size_t(k))
+        throw invalid_argument("klogic::class_decoder::sectors(): k labels expected");
+
+    class_decoder result(DECODE_SECTORS, 1);
+
+    result.k = k;
+    result.sector_labels = labels;
+
+    return result;
+}
+
+klogic::class_decoder klogic::class_decoder::rejecting(int classes, int sectors_per_class)
+{
+    if (classes <= 0 || sectors_per_class < 3)
+        throw invalid_argument("klogic::class_decoder::rejecting(): at least 3 sectors per class expected");
+
+    vector<int> labels(classes * sectors_per_class);
+
+    for (int c = 0; c < classes; ++c) {
+        int first = c * sectors_per_class, last = first + sectors_per_class - 1;
+
+        for (int s = first; s <= last; ++s)
+            labels[s] = (s == first || s == last) ? REJECTED : c;
+    }
+
+    return sectors(classes * sectors_per_class, labels);
+}
+
+klogic::class_decoder klogic::class_decoder::winner(size_t outputs, double target_phase,
+                                                    double min_score, double min_gap)
+{
+    if (outputs == 0)
+        throw invalid_argument("klogic::class_decoder::winner(): no outputs");
+
+    class_decoder result(DECODE_WINNER, outputs);
+
+    result.target    = polar(scalar(1), scalar(target_phase));
+    result.min_score = min_score;
+    result.min_gap   = min_gap;
+
+    return result;
+}
+
+void klogic::class_decoder::decode(const klogic::cmplx *z, size_t count, int *labels) const
+{
+    if (kind == DECODE_SECTORS)
+        decode_sectors(z, count, labels);
+    else
+        decode_winner(z, count, labels);
+}
+
+void klogic::class_decoder::decode_sectors(const klogic::cmplx *z, size_t count, int *labels) const
+{
+    // Vectorized sectors. Phase rounded up to 2pi gives sector k, i.e. 0
+    kernels::sectors(k, z, count, labels);
+
+    for (size_t i = 0; i < count; ++i) {
+        int s = labels[i] == k ? 0 : labels[i];
+
+        // NaN sums are rejected
+        labels[i] = (s >= 0 && s < k) ? sector_labels[s] : REJECTED;
+    }
+}
+
+void klogic::class_decoder::decode_winner(const klogic::cmplx *z, size_t count, int *labels) const
+{
+    scalar best[WINNER_BLOCK], second[WINNER_BLOCK];
+    int    winner[WINNER_BLOCK];
+
+    scalar tr = target.real(), ti = target.imag();
+
+    for (size_t done = 0; done < count; done += WINNER_BLOCK) {
+        size_t block = std::min(WINNER_BLOCK, count - done);
+        const scalar *pz = reinterpret_cast<const scalar *>(z + done * noutputs);
+
+        std::fill(best, best + block, NO_SCORE - 1);
+        std::fill(second, second + block, NO_SCORE - 1);
+        std::fill(winner, winner + block, 0);
+
+        // Neuron by neuron, so the inner loop over samples has no
+        // dependencies and is vectorized
+        for (size_t j = 0; j < noutputs; ++j) {
+            for (size_t b = 0; b < block; ++b) {
+                scalar re = pz[2 * (b * noutputs + j)], im = pz[2 * (b * noutputs + j) + 1];
+                scalar n = re * re + im * im;
+                scalar score = n > 0 ? (re * tr + im * ti) / std::sqrt(n) : NO_SCORE;
+                bool   top = score > best[b];
+
+                second[b] = top ? best[b] : std::max(second[b], score);
+                best[b]   = top ? score : best[b];
+                winner[b] = top ? int(j) : winner[b];
+            }
+        }
+
+        for (size_t b = 0; b < block; ++b) {
+            bool sure = best[b] >= min_score && best[b] - second[b] >= min_gap;
+
+            labels[done + b] = sure ? winner[b] : REJECTED;
+        }
+    }
+}
+
+//-------------------------------------------------------------------------
+
+klogic::mlmvn_classifier::mlmvn_classifier(const klogic::mlmvn &net, const klogic::class_decoder &_decoder,
+                                           size_t max_batch)
+    : input_size(net.input_layer_size()), forward(net, max_batch), decoder(_decoder),
+      sums(max_batch * net.output_layer_size())
+{
+    if (decoder.outputs() != net.output_layer_size())
+        throw invalid_argument("klogic::mlmvn_classifier: decoder doesn't match output layer size");
+}
+
+void klogic::mlmvn_classifier::classify(const klogic::cmplx *X, size_t count, int *labels)
+{
+    size_t batch = forward.max_batch();
+
+    for (size_t done = 0; done < count; done += batch) {
+        size_t block = std::min(batch, count - done);
+
+        forward.weighted_sums(X + done * input_size, block, sums.data());
+        decoder.decode(sums.data(), block, labels + done);
+    }
+}
+
+void klogic::mlmvn_classifier::classify(const vector<klogic::cvector> &X, vector<int> &labels)
+{
+    size_t batch = forward.max_batch();
+
+    packed_in.resize(batch * input_size);
+    labels.resize(X.size());
+
+    for (size_t done = 0; done < X.size(); done += batch) {
+        size_t block = std::min(batch, X.size() - done);
+
+        for (size_t b = 0; b < block; ++b) {
+            assert(X[done + b].size() == input_size);
+            std::copy(X[done + b].begin(), X[done + b].end(), packed_in.begin() + b * input_size);
+        }
+
+        classify(packed_in.data(), block, labels.data() + done);
+    }
+}
+
+int klogic::mlmvn_classifier::classify(klogic::const_cspan X)
+{
+    assert(X.size() == input_size);
+
+    int label;
+
+    classify(X.begin(), 1, &label);
+
+    return label;
+}
@@ -0,0 +1,104 @@
+// Classification with MLMVN
+//
+// class_decoder turns output neurons' values into class labels for whole
+// blocks of samples. It looks at phases only, so it is given the output
+// layer's weighted sums (mlmvn_batch_forward::weighted_sums()): a
+// discrete neuron's output is the start of the sector its weighted sum
+// falls in, and the sum also tells how close to a border that was.
+//
+// Two schemes are supported:
+//  - sectors: one output neuron whose phase range is split into k equal
+//    sectors, sector s (phases 2pi*s/k..2pi*(s+1)/k, see sector_number())
+//    gives labels[s]. Sectors labelled REJECTED are rejection sectors,
+//    e.g. narrow bands around class borders (see rejecting()), and
+//    several sectors may share a label (periodic activation)
+//  - winner take all: one output neuron per class, the class is the
+//    neuron whose phase is the nearest to the target phase. The answer
+//    is rejected if the winner is not near enough to the target or the
+//    runner-up is too close to it
+#pragma once
+
+#include <vector>
+#include "klogic.h"
+#include "mlmvn.h"
+
+namespace klogic {
+    class class_decoder {
+    public:
+        // Label of rejected samples
+        static const int REJECTED = -1;
+
+        // Sector s of k goes to labels[s] (class number or REJECTED).
+        // Throws std::invalid_argument unless labels has k entries
+        static class_decoder sectors(int k, const std::vector<int> &labels);
+
+        // `classes` sectors of equal width, each split into
+        // sectors_per_class parts; the first and the last part of each
+        // class sector are rejection sectors. E.g. 10 parts reject the
+        // 20% of phases nearest to class borders
+        static class_decoder rejecting(int classes, int sectors_per_class);
+
+        // Winner take all among `outputs` neurons. Score of a neuron is
+        // cos(phase - target_phase), the winner has the highest score.
+        // Rejected if its score is below min_score or exceeds the
+        // runner-up's by less than min_gap
+        static class_decoder winner(size_t outputs, double target_phase = 0,
+                                    double min_score = -1, double min_gap = 0);
+
+        // Output values per sample
+        size_t outputs() const { return noutputs; }
+
+        // Labels of `count` samples, outputs() values of each one after
+        // another in z
+        void decode(const cmplx *z, size_t count, int *labels) const;
+
+    private:
+        enum decoder_kind { DECODE_SECTORS, DECODE_WINNER };
+
+        class_decoder(decoder_kind _kind, size_t _outputs)
+            : kind(_kind), noutputs(_outputs), k(0), target(1), min_score(-1), min_gap(0) {}
+
+        void decode_sectors(const cmplx *z, size_t count, int *labels) const;
+        void decode_winner(const cmplx *z, size_t count, int *labels) const;
+
+        decoder_kind kind;
+        size_t noutputs;
+
+        // Sector scheme: labels by sector number
+        int k;
+        std::vector<int> sector_labels;
+
+        // Winner scheme: unit vector of target phase and rejection
+        // thresholds
+        cmplx target;
+        scalar min_score, min_gap;
+    };
+
+    // mlmvn with a class_decoder: forward passes go in blocks through
+    // mlmvn_batch_forward, then a whole block is decoded at once
+    class mlmvn_classifier {
+    public:
+        // Throws std::invalid_argument if decoder.outputs() differs from
+        // the output layer size
+        mlmvn_classifier(const mlmvn &net, const class_decoder &decoder, size_t max_batch = 64);
+
+        // Labels of `count` samples, packed as in
+        // mlmvn_batch_forward::output()
+        void classify(const cmplx *X, size_t count, int *labels);
+
+        // The same for samples kept in separate vectors. labels is resized
+        void classify(const std::vector<cvector> &X, std::vector<int> &labels);
+
+        // Label of one sample
+        int classify(const_cspan X);
+
+    private:
+        size_t input_size;
+        mlmvn_batch_forward forward;
+        class_decoder decoder;
+
+        // Weighted sums of the output layer for a block and packed inputs
+        // for classify(vector, vector)
+        aligned_cvector sums, packed_in;
+    };
+}
@@ -0,0 +1,334 @@
+#include <cstring>
+#include <istream>
+#include <memory>
+#include <sstream>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "dataset.h"
+
+using namespace std;
+
+static_assert(sizeof(klogic::learning::dataset_header) == 64, "dataset header must take 64 bytes");
+
+namespace {
+    const char MAGIC[8] = "MVNDATA";
+
+    size_t encoded_value_size(uint32_t encoding) {
+        switch (encoding) {
+        case klogic::learning::COMPLEX:       return sizeof(complex<double>);
+        case klogic::learning::COMPLEX_FLOAT: return sizeof(complex<float>);
+        case klogic::learning::PHASE:         return sizeof(double);
+        default:                              return 0;
+        }
+    }
+
+    // Phase of a value from CSV/table, see csv_to_dataset(). Integers
+    // give the same phase as klogic::epsilon()
+    double value_phase(int k, double x) {
+        if (k > 0) {
+            int n = int(x);
+
+            if (n != x || n < 0 || n >= k)
+                throw runtime_error("klogic::learning: value is not in [0..k) range");
+
+            return (klogic::TWOPI * n) / k;
+        }
+
+        if (x < 0 || x >= klogic::TWOPI)
+            throw runtime_error("klogic::learning: phase is not in [0..2pi) range");
+
+        return x;
+    }
+
+    // Copy n stored complex values of type T to cmplx
+    template<typename T>
+    void convert(const char *from, size_t n, klogic::cmplx *to) {
+        const complex<T> *values = reinterpret_cast<const complex<T> *>(from);
+
+        for (size_t i = 0; i < n; ++i)
+            to[i] = klogic::cmplx(values[i]);
+    }
+
+    template<typename T>
+    bool write_converted(klogic::const_cspan values, FILE *file) {
+        vector<complex<T> > converted(values.begin(), values.end());
+
+        return fwrite(converted.data(), sizeof(complex<T>), converted.size(), file) == converted.size();
+    }
+}
+
+klogic::learning::mapped_dataset::mapped_dataset(const string &path)
+    : mapping(MAP_FAILED), mapping_size(0)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+
+    if (fd < 0)
+        throw runtime_error("klogic::learning::mapped_dataset: can't open " + path);
+
+    struct stat st;
+
+    if (fstat(fd, &st) != 0 || size_t(st.st_size) < sizeof(dataset_header)) {
+        ::close(fd);
+        throw runtime_error("klogic::learning::mapped_dataset: " + path + " is not a dataset");
+    }
+
+    mapping_size = st.st_size;
+    mapping = mmap(0, mapping_size, PROT_READ, MAP_SHARED, fd, 0);
+
+    // Mapping stays valid after the descriptor is closed
+    ::close(fd);
+
+    if (mapping == MAP_FAILED)
+        throw runtime_error("klogic::learning::mapped_dataset: can't map " + path);
+
+    header     = static_cast<const dataset_header *>(mapping);
+    data       = static_cast<const char *>(mapping) + sizeof(dataset_header);
+    value_size = encoded_value_size(header->encoding);
+
+    const char *error = 0;
+
+    if (memcmp(header->magic, MAGIC, sizeof(MAGIC)) != 0)
+        error = " is not a dataset";
+    else if (header->version != DATASET_VERSION)
+        error = " has unsupported version";
+    else if (value_size == 0)
+        error = " has unknown encoding";
+    else {
+        record_size = (header->input_size + header->desired_size) * value_size;
+
+        if ((mapping_size - sizeof(dataset_header)) / (record_size ? record_size : 1) < header->count)
+            error = " is truncated";
+    }
+
+    if (error) {
+        munmap(mapping, mapping_size);
+        throw runtime_error("klogic::learning::mapped_dataset: " + path + error);
+    }
+}
+
+klogic::learning::mapped_dataset::~mapped_dataset()
+{
+    munmap(mapping, mapping_size);
+}
+
+klogic::const_cspan klogic::learning::mapped_dataset::input(size_t i) const
+{
+    assert(encoding() == NATIVE_COMPLEX);
+
+    return const_cspan(reinterpret_cast<const cmplx *>(record(i)), input_size());
+}
+
+klogic::const_cspan klogic::learning::mapped_dataset::desired(size_t i) const
+{
+    assert(encoding() == NATIVE_COMPLEX);
+
+    return const_cspan(reinterpret_cast<const cmplx *>(record(i)) + input_size(), desired_size());
+}
+
+void klogic::learning::mapped_dataset::decode(size_t i, cmplx *input, cmplx *desired) const
+{
+    const char *rec = record(i);
+    size_t n_input = input_size(), n_desired = desired_size();
+
+    if (encoding() == COMPLEX) {
+        convert<double>(rec, n_input, input);
+        convert<double>(rec + n_input * value_size, n_desired, desired);
+    } else if (encoding() == COMPLEX_FLOAT) {
+        convert<float>(rec, n_input, input);
+        convert<float>(rec + n_input * value_size, n_desired, desired);
+    } else {
+        const double *phases = reinterpret_cast<const double *>(rec);
+
+        for (size_t j = 0; j < n_input; ++j)
+            input[j] = polar(scalar(1), scalar(phases[j]));
+
+        for (size_t j = 0; j < n_desired; ++j)
+            desired[j] = polar(scalar(1), scalar(phases[n_input + j]));
+    }
+}
+
+void klogic::learning::mapped_dataset::advise_sequential() const
+{
+    madvise(mapping, mapping_size, MADV_SEQUENTIAL);
+}
+
+// ------------------
+
+klogic::learning::dataset_writer::dataset_writer(const string &path, dataset_encoding encoding,
+                                                 size_t input_size, size_t desired_size, int k)
+{
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, MAGIC, sizeof(MAGIC));
+
+    header.version      = DATASET_VERSION;
+    header.encoding     = encoding;
+    header.k            = k;
+    header.input_size   = input_size;
+    header.desired_size = desired_size;
+
+    file = fopen(path.c_str(), "wb");
+
+    if (!file)
+        throw runtime_error("klogic::learning::dataset_writer: can't create " + path);
+
+    // Count is not known yet, header is rewritten by close()
+    if (fwrite(&header, sizeof(header), 1, file) != 1) {
+        fclose(file);
+        throw runtime_error("klogic::learning::dataset_writer: can't write " + path);
+    }
+}
+
+klogic::learning::dataset_writer::~dataset_writer()
+{
+    try {
+        close();
+    } catch (...) {
+    }
+}
+
+void klogic::learning::dataset_writer::add(const_cspan input, const_cspan desired)
+{
+    assert(file);
+
+    if (input.size() != header.input_size || desired.size() != header.desired_size)
+        throw invalid_argument("klogic::learning::dataset_writer::add: wrong sample size");
+
+    write_values(input);
+    write_values(desired);
+
+    ++header.count;
+}
+
+void klogic::learning::dataset_writer::add_phases(const double *phases)
+{
+    assert(file);
+
+    write_phases(phases, header.input_size + header.desired_size);
+
+    ++header.count;
+}
+
+void klogic::learning::dataset_writer::write_values(const_cspan values)
+{
+    if (header.encoding == COMPLEX || header.encoding == COMPLEX_FLOAT) {
+        bool ok = header.encoding == COMPLEX ? write_converted<double>(values, file)
+                                             : write_converted<float>(values, file);
+
+        if (!ok)
+            throw runtime_error("klogic::learning::dataset_writer: write failed");
+    } else {
+        vector<double> phases(values.size());
+
+        for (size_t i = 0; i < values.size(); ++i)
+            phases[i] = phase(values[i]);
+
+        write_phases(phases.data(), phases.size());
+    }
+}
+
+void klogic::learning::dataset_writer::write_phases(const double *phases, size_t n)
+{
+    if (header.encoding != PHASE) {
+        cvector values(n);
+
+        for (size_t i = 0; i < n; ++i)
+            values[i] = polar(scalar(1), scalar(phases[i]));
+
+        write_values(values);
+    } else if (fwrite(phases, sizeof(double), n, file) != n)
+        throw runtime_error("klogic::learning::dataset_writer: write failed");
+}
+
+void klogic::learning::dataset_writer::close()
+{
+    if (!file)
+        return;
+
+    bool ok = fseek(file, 0, SEEK_SET) == 0
+        && fwrite(&header, sizeof(header), 1, file) == 1;
+
+    ok = fclose(file) == 0 && ok;
+    file = 0;
+
+    if (!ok)
+        throw runtime_error("klogic::learning::dataset_writer: write failed");
+}
+
+// ------------------
+
+void klogic::learning::table_to_dataset(const string &path, int k,
+                                        const int *table, size_t rows,
+                                        size_t input_size, size_t desired_size,
+                                        dataset_encoding encoding)
+{
+    assert(k > 0);
+
+    dataset_writer writer(path, encoding, input_size, desired_size, k);
+    vector<double> phases(input_size + desired_size);
+
+    for (size_t row = 0; row < rows; ++row) {
+        for (size_t i = 0; i < phases.size(); ++i)
+            phases[i] = value_phase(k, *table++);
+
+        writer.add_phases(phases.data());
+    }
+
+    writer.close();
+}
+
+size_t klogic::learning::csv_to_dataset(istream &csv, const string &path,
+                                        size_t input_size, int k,
+                                        dataset_encoding encoding)
+{
+    // Writer is created when the first line tells the desired size
+    unique_ptr<dataset_writer> writer;
+    vector<double> phases;
+    size_t writer_desired = 0;
+    string line;
+    size_t line_number = 0;
+
+    while (getline(csv, line)) {
+        ++line_number;
+
+        if (line.empty() || line[0] == '#' || line.find_first_not_of(" \t\r") == string::npos)
+            continue;
+
+        istringstream fields(line);
+        string field;
+
+        phases.clear();
+
+        while (getline(fields, field, ',')) {
+            istringstream number(field);
+            double x;
+
+            if (!(number >> x) || !(number >> ws).eof())
+                throw runtime_error("klogic::learning::csv_to_dataset: bad number at line "
+                                    + to_string(line_number));
+
+            phases.push_back(value_phase(k, x));
+        }
+
+        if (phases.size() <= input_size || (writer && phases.size() != input_size + writer_desired))
+            throw runtime_error("klogic::learning::csv_to_dataset: wrong number of values at line "
+                                + to_string(line_number));
+
+        if (!writer) {
+            writer_desired = phases.size() - input_size;
+            writer.reset(new dataset_writer(path, encoding, input_size, writer_desired, k));
+        }
+
+        writer->add_phases(phases.data());
+    }
+
+    // Empty input gives an empty dataset with no desired values
+    if (!writer)
+        writer.reset(new dataset_writer(path, encoding, input_size, 0, k));
+
+    writer->close();
+
+    return writer->size();
+}
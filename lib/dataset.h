@@ -0,0 +1,302 @@
+// Binary on-disk format for learning samples
+//
+// File starts with a 64-byte header (see dataset_header) followed by
+// `count` records. Each record holds input_size input values and then
+// desired_size desired values. Values are stored in native byte order:
+//
+//   COMPLEX       - std::complex<double>, 16 bytes
+//   COMPLEX_FLOAT - std::complex<float>, 8 bytes
+//   PHASE         - double phase in [0..2pi), 8 bytes. Each value has to
+//                   be decoded with std::polar()
+//
+// Records of the encoding matching klogic::cmplx (NATIVE_COMPLEX) can be
+// used in place, so a mapped file feeds teacher without copying
+#pragma once
+
+#include <cstddef>
+#include <iosfwd>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <cstdio>
+#include <stdint.h>
+#include "klogic.h"
+#include "storage.h"
+#include "learning.h"
+
+namespace klogic {
+    namespace learning {
+        enum dataset_encoding {
+            COMPLEX       = 0,
+            PHASE         = 1,
+            COMPLEX_FLOAT = 2
+        };
+
+#ifdef KLOGIC_FLOAT
+        const dataset_encoding NATIVE_COMPLEX = COMPLEX_FLOAT;
+#else
+        const dataset_encoding NATIVE_COMPLEX = COMPLEX;
+#endif
+
+        struct dataset_header {
+            char     magic[8];          // "MVNDATA\0"
+            uint32_t version;
+            uint32_t encoding;          // dataset_encoding
+            int32_t  k;                 // k-valued logic, 0 for continuous
+            uint32_t reserved;
+            uint64_t input_size;
+            uint64_t desired_size;
+            uint64_t count;             // number of records
+            char     padding[16];
+        };
+
+        const uint32_t DATASET_VERSION = 1;
+
+        // ------------------
+
+        // Read-only dataset file mapped to memory. Pages are read by the OS
+        // when touched, so files bigger than RAM are fine. Errors are
+        // reported with std::runtime_error
+        class mapped_dataset {
+        public:
+            mapped_dataset(const std::string &path);
+            ~mapped_dataset();
+
+            dataset_encoding encoding() const { return dataset_encoding(header->encoding); }
+            int k() const { return header->k; }
+
+            size_t input_size() const   { return header->input_size; }
+            size_t desired_size() const { return header->desired_size; }
+
+            // Number of records
+            size_t size() const { return header->count; }
+
+            // Values of i-th record used in place, NATIVE_COMPLEX encoding only
+            const_cspan input(size_t i) const;
+            const_cspan desired(size_t i) const;
+
+            // Values of i-th record converted to complex numbers, works
+            // for any encoding. input and desired receive input_size()
+            // and desired_size() values
+            void decode(size_t i, cmplx *input, cmplx *desired) const;
+
+            // Tell the OS the file is going to be read sequentially
+            void advise_sequential() const;
+
+        private:
+            // Non-copyable
+            mapped_dataset(const mapped_dataset &);
+            mapped_dataset &operator=(const mapped_dataset &);
+
+            const char *record(size_t i) const {
+                assert(i < size());
+                return data + i * record_size;
+            }
+
+            void *mapping;
+            size_t mapping_size;
+
+            const dataset_header *header;
+            const char *data;
+            size_t value_size, record_size;
+        };
+
+        // ------------------
+
+        // Sample pointing into a mapped dataset. desired_type is the one of
+        // learning::sample<Desired> so teacher and learners see no
+        // difference
+        template<typename Desired>
+        struct mapped_sample {};
+
+        template<>
+        struct mapped_sample<cvector> {
+            typedef cvector desired_type;
+
+            const_cspan input;
+            const_cspan desired;
+
+            mapped_sample(const mapped_dataset &set, size_t i)
+                : input(set.input(i)), desired(set.desired(i)) {}
+        };
+
+        template<>
+        struct mapped_sample<cmplx> {
+            typedef cmplx desired_type;
+
+            const_cspan input;
+            cmplx desired;
+
+            mapped_sample(const mapped_dataset &set, size_t i)
+                : input(set.input(i)), desired(set.desired(i)[0]) {}
+        };
+
+        // Samples of a mapped dataset as a SampleSet for teacher, e.g.
+        //
+        //   mapped_dataset file("train.mvn");
+        //   typedef mapped_sample<cvector> sample_type;
+        //   teacher<mlmvn, sample_type, learn_error<cvector>,
+        //           mapped_samples<cvector> > t(net, mapped_samples<cvector>(file));
+        //
+        // Only NATIVE_COMPLEX encoding can be used in place. Samples are created
+        // when iterator is dereferenced, so iterators return them by value
+        template<typename Desired>
+        class mapped_samples {
+        public:
+            typedef mapped_sample<Desired> value_type;
+
+            class const_iterator {
+            public:
+                typedef std::random_access_iterator_tag iterator_category;
+                typedef mapped_sample<Desired>          value_type;
+                typedef std::ptrdiff_t                  difference_type;
+                typedef value_type                      reference;
+
+                // operator-> needs an object to point to
+                class pointer {
+                public:
+                    pointer(const value_type &v) : value(v) {}
+                    const value_type *operator->() const { return &value; }
+                private:
+                    value_type value;
+                };
+
+                const_iterator() : set(0), index(0) {}
+                const_iterator(const mapped_dataset *s, size_t i) : set(s), index(i) {}
+
+                reference operator*() const { return value_type(*set, index); }
+                pointer operator->() const  { return pointer(**this); }
+                reference operator[](difference_type n) const { return value_type(*set, index + n); }
+
+                const_iterator &operator++() { ++index; return *this; }
+                const_iterator &operator--() { --index; return *this; }
+                const_iterator operator++(int) { const_iterator t(*this); ++index; return t; }
+                const_iterator operator--(int) { const_iterator t(*this); --index; return t; }
+
+                const_iterator &operator+=(difference_type n) { index += n; return *this; }
+                const_iterator &operator-=(difference_type n) { index -= n; return *this; }
+
+                const_iterator operator+(difference_type n) const { return const_iterator(set, index + n); }
+                const_iterator operator-(difference_type n) const { return const_iterator(set, index - n); }
+
+                difference_type operator-(const const_iterator &other) const {
+                    return difference_type(index) - difference_type(other.index);
+                }
+
+                bool operator==(const const_iterator &other) const { return index == other.index; }
+                bool operator!=(const const_iterator &other) const { return index != other.index; }
+                bool operator<(const const_iterator &other) const  { return index < other.index; }
+
+            private:
+                const mapped_dataset *set;
+                size_t index;
+            };
+
+            typedef const_iterator iterator;
+
+            mapped_samples() : set(0), count(0) {}
+
+            mapped_samples(const mapped_dataset &_set)
+                : set(&_set), count(_set.size())
+            {
+                if (set->encoding() != NATIVE_COMPLEX)
+                    throw std::runtime_error("klogic::learning::mapped_samples: dataset encoding can't be used in place");
+
+                if (!desired_size_matches())
+                    throw std::runtime_error("klogic::learning::mapped_samples: desired size doesn't match sample type");
+            }
+
+            const_iterator begin() const { return const_iterator(set, 0); }
+            const_iterator end() const   { return const_iterator(set, count); }
+
+            size_t size() const { return count; }
+            bool empty() const { return count == 0; }
+
+            value_type operator[](size_t i) const {
+                assert(i < count);
+                return value_type(*set, i);
+            }
+
+        private:
+            bool desired_size_matches() const;
+
+            const mapped_dataset *set;
+            size_t count;
+        };
+
+        template<>
+        inline bool mapped_samples<cmplx>::desired_size_matches() const {
+            return set->desired_size() == 1;
+        }
+
+        template<>
+        inline bool mapped_samples<cvector>::desired_size_matches() const {
+            return true;
+        }
+
+        // ------------------
+
+        // Writes dataset files. Header is completed by close() (called by
+        // destructor too), so records may be added without knowing their
+        // count in advance
+        class dataset_writer {
+        public:
+            dataset_writer(const std::string &path, dataset_encoding encoding,
+                           size_t input_size, size_t desired_size, int k = 0);
+            ~dataset_writer();
+
+            // Append a record. Sizes must match the ones given to constructor
+            void add(const_cspan input, const_cspan desired);
+
+            void add(const_cspan input, const cmplx &desired) {
+                add(input, const_cspan(&desired, 1));
+            }
+
+            template<typename Desired>
+            void add(const sample<Desired> &s) {
+                add(s.input, s.desired);
+            }
+
+            // Append a record of unit values given by their phases:
+            // input_size() + desired_size() values. Unlike add() this
+            // keeps PHASE encoded values exact
+            void add_phases(const double *phases);
+
+            // Records written so far
+            size_t size() const { return header.count; }
+
+            void close();
+
+        private:
+            // Non-copyable
+            dataset_writer(const dataset_writer &);
+            dataset_writer &operator=(const dataset_writer &);
+
+            void write_values(const_cspan values);
+            void write_phases(const double *phases, size_t n);
+
+            std::FILE *file;
+            dataset_header header;
+        };
+
+        // ------------------
+
+        // Convert a table of integer k-valued samples, like the ones in
+        // test/post_function.cc: `rows` rows of input_size inputs followed
+        // by desired_size desired values, each in [0..k). Values become
+        // k-th roots of unity (transform::discrete)
+        void table_to_dataset(const std::string &path, int k,
+                              const int *table, size_t rows,
+                              size_t input_size, size_t desired_size,
+                              dataset_encoding encoding = COMPLEX);
+
+        // Convert CSV: one sample per line, first input_size values are
+        // inputs, the rest are desired values. If k > 0 values are integers
+        // in [0..k), otherwise they are phases in [0..2pi)
+        // (transform::continuous). Empty lines and lines starting with '#'
+        // are skipped. Returns number of samples written
+        size_t csv_to_dataset(std::istream &csv, const std::string &path,
+                              size_t input_size, int k,
+                              dataset_encoding encoding = COMPLEX);
+    }
+}
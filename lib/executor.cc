@@ -0,0 +1,165 @@
+#include <algorithm>
+#include <stdexcept>
+#include "executor.h"
+
+using namespace std;
+
+klogic::mlmvn_executor::mlmvn_executor(const mlmvn &_net, const executor_options &options)
+    : net(_net), opts(options), sleeping(false), stopping(false)
+{
+    if (opts.threads == 0)
+        opts.threads = max(1u, thread::hardware_concurrency());
+
+    if (opts.max_batch == 0)
+        opts.max_batch = 1;
+
+    for (size_t i = 0; i < opts.threads; ++i)
+        workers.push_back(thread(&mlmvn_executor::work, this));
+}
+
+klogic::mlmvn_executor::~mlmvn_executor()
+{
+    {
+        lock_guard<mutex> lock(wakeup_mutex);
+
+        stopping.store(true);
+        wakeup.notify_all();
+    }
+
+    for (size_t i = 0; i < workers.size(); ++i)
+        workers[i].join();
+}
+
+future<klogic::cvector> klogic::mlmvn_executor::submit(const_cspan X)
+{
+    if (X.size() != net.input_layer_size())
+        throw invalid_argument("klogic::mlmvn_executor::submit(): wrong input size");
+
+    request *r = new request;
+
+    r->input.assign(X.begin(), X.end());
+    r->submitted = clock::now();
+
+    future<cvector> result = r->result.get_future();
+
+    queue.push(r);
+
+    // See wait_first()
+    if (sleeping.load()) {
+        lock_guard<mutex> lock(wakeup_mutex);
+        wakeup.notify_one();
+    }
+
+    return result;
+}
+
+void klogic::mlmvn_executor::work()
+{
+    // Each worker has its own buffers
+    mlmvn_batch_forward forward(net, opts.max_batch);
+    aligned_cvector inputs(opts.max_batch * net.input_layer_size());
+    aligned_cvector outputs(opts.max_batch * net.output_layer_size());
+    vector<request *> batch;
+
+    batch.reserve(opts.max_batch);
+
+    for (;;) {
+        batch.clear();
+
+        {
+            lock_guard<mutex> collecting(collector);
+
+            if (!collect(batch))
+                return;
+        }
+
+        run(batch, forward, inputs, outputs);
+    }
+}
+
+bool klogic::mlmvn_executor::collect(vector<request *> &batch)
+{
+    request *first = wait_first();
+
+    if (!first)
+        return false;
+
+    batch.push_back(first);
+
+    clock::time_point deadline = first->submitted + opts.max_delay;
+
+    while (batch.size() < opts.max_batch) {
+        if (request *r = queue.pop()) {
+            batch.push_back(r);
+            continue;
+        }
+
+        if (stopping.load() || clock::now() >= deadline)
+            break;
+
+        this_thread::yield();
+    }
+
+    return true;
+}
+
+klogic::mlmvn_executor::request *klogic::mlmvn_executor::wait_first()
+{
+    for (;;) {
+        if (request *r = queue.pop())
+            return r;
+
+        unique_lock<mutex> lock(wakeup_mutex);
+
+        // A producer links its node before it checks sleeping, we set
+        // sleeping before we check the queue. All of it is sequentially
+        // consistent, so either pop() sees the node or the producer sees
+        // sleeping and notifies, which can't happen before wait() since
+        // we hold the mutex. A push caught halfway is no exception: its
+        // producer hasn't checked sleeping yet
+        sleeping.store(true);
+
+        request *r = queue.pop();
+
+        if (!r && !stopping.load())
+            wakeup.wait(lock);
+
+        sleeping.store(false);
+
+        if (r)
+            return r;
+
+        if (stopping.load())
+            return queue.pop();
+    }
+}
+
+void klogic::mlmvn_executor::run(const vector<request *> &batch, mlmvn_batch_forward &forward,
+                                 aligned_cvector &inputs, aligned_cvector &outputs)
+{
+    size_t in_size = net.input_layer_size(), out_size = net.output_layer_size();
+
+    try {
+        for (size_t b = 0; b < batch.size(); ++b)
+            copy(batch[b]->input.begin(), batch[b]->input.end(), inputs.begin() + b * in_size);
+
+        forward.output(inputs.data(), batch.size(), outputs.data());
+
+        for (size_t b = 0; b < batch.size(); ++b) {
+            aligned_cvector::const_iterator out = outputs.begin() + b * out_size;
+
+            batch[b]->result.set_value(cvector(out, out + out_size));
+        }
+    } catch (...) {
+        for (size_t b = 0; b < batch.size(); ++b) {
+            try {
+                batch[b]->result.set_exception(current_exception());
+            } catch (const future_error &) {
+                // Value was set already
+            }
+        }
+    }
+
+    for (size_t b = 0; b < batch.size(); ++b)
+        delete batch[b];
+}
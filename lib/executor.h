@@ -0,0 +1,157 @@
+// Inference executor: requests from many threads are gathered into
+// micro-batches and run by worker threads
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "mlmvn.h"
+
+namespace klogic {
+    // Intrusive multi-producer single-consumer queue (D. Vyukov's). Node
+    // must have `std::atomic<Node *> next`. push() is wait-free and may be
+    // called from any thread, pop() only by one thread at a time. Memory
+    // order is sequentially consistent, so a producer checking a flag
+    // after push() and a consumer setting it before pop() can't miss each
+    // other (see mlmvn_executor)
+    template<typename Node>
+    class mpsc_queue {
+    public:
+        mpsc_queue() : head(&stub), tail(&stub) { stub.next.store(0); }
+
+        void push(Node *node) {
+            node->next.store(0);
+
+            Node *prev = head.exchange(node);
+
+            prev->next.store(node);
+        }
+
+        // Oldest node or 0 if the queue is empty or a push is halfway done
+        Node *pop() {
+            Node *first = tail, *next = first->next.load();
+
+            if (first == &stub) {
+                if (!next)
+                    return 0;
+
+                tail  = next;
+                first = next;
+                next  = next->next.load();
+            }
+
+            if (next) {
+                tail = next;
+                return first;
+            }
+
+            if (first != head.load())
+                return 0;
+
+            // first is the last node: put stub after it to take it out
+            push(&stub);
+            next = first->next.load();
+
+            if (next) {
+                tail = next;
+                return first;
+            }
+
+            return 0;
+        }
+
+    private:
+        // Non-copyable
+        mpsc_queue(const mpsc_queue &);
+        mpsc_queue &operator=(const mpsc_queue &);
+
+        Node stub;
+        std::atomic<Node *> head;
+        Node *tail;
+    };
+
+    //--------------------------------------------------------------
+
+    // Executor settings
+    struct executor_options {
+        // Worker threads, 0 means number of hardware threads
+        size_t threads;
+
+        // Most requests in one batch
+        size_t max_batch;
+
+        // How long the first request of a batch may wait for others
+        std::chrono::microseconds max_delay;
+
+        executor_options() : threads(0), max_batch(32), max_delay(200) {}
+    };
+
+    // Inference server for a shared read-only network. submit() takes one
+    // input from any thread and returns a future of the network output.
+    // Requests go through a lock-free queue. Workers take turns collecting
+    // them: the collecting worker takes requests until it has max_batch of
+    // them or the first one has waited max_delay, then runs them with
+    // mlmvn_batch_forward while the next worker collects. The network must
+    // not change while the executor runs
+    class mlmvn_executor {
+    public:
+        mlmvn_executor(const mlmvn &net, const executor_options &options = executor_options());
+
+        // Finishes requests already submitted
+        ~mlmvn_executor();
+
+        // Queue X for calculation. Throws std::invalid_argument if its size
+        // doesn't match the network
+        std::future<cvector> submit(const_cspan X);
+
+        const executor_options &options() const { return opts; }
+
+    private:
+        typedef std::chrono::steady_clock clock;
+
+        struct request {
+            std::atomic<request *> next;
+            cvector input;
+            std::promise<cvector> result;
+            clock::time_point submitted;
+        };
+
+        // Non-copyable
+        mlmvn_executor(const mlmvn_executor &);
+        mlmvn_executor &operator=(const mlmvn_executor &);
+
+        void work();
+
+        // Take the next batch from the queue. Called by one worker at a
+        // time. Returns false when the executor stops and there is nothing
+        // left to do
+        bool collect(std::vector<request *> &batch);
+
+        // Wait for a request, 0 if the executor stops
+        request *wait_first();
+
+        void run(const std::vector<request *> &batch, mlmvn_batch_forward &forward,
+                 aligned_cvector &inputs, aligned_cvector &outputs);
+
+        const mlmvn &net;
+        executor_options opts;
+
+        mpsc_queue<request> queue;
+
+        // Held by the worker collecting a batch
+        std::mutex collector;
+
+        // Collecting worker sleeps here when there are no requests.
+        // Producers notify it only if sleeping is set
+        std::mutex wakeup_mutex;
+        std::condition_variable wakeup;
+        std::atomic<bool> sleeping;
+        std::atomic<bool> stopping;
+
+        std::vector<std::thread> workers;
+    };
+}
@@ -0,0 +1,915 @@
+#include <algorithm>
+#include <atomic>
+#include "kernels.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define KLOGIC_X86_DISPATCH
+#include <immintrin.h>
+#endif
+
+using namespace klogic;
+using namespace klogic::kernels;
+
+namespace {
+    // Plain version. Avoids std::complex multiplication since it does
+    // NaN/Inf recovery we don't need
+    cmplx dot_scalar(const cmplx *w, const cmplx *x, size_t n)
+    {
+        const scalar *pw = reinterpret_cast<const scalar *>(w);
+        const scalar *px = reinterpret_cast<const scalar *>(x);
+
+        scalar re = 0, im = 0;
+
+        for (size_t i = 0; i < 2 * n; i += 2) {
+            re += pw[i] * px[i]     - pw[i + 1] * px[i + 1];
+            im += pw[i] * px[i + 1] + pw[i + 1] * px[i];
+        }
+
+        return cmplx(re, im);
+    }
+
+    // Scalar dot product with x gathered at columns (sparse rows). Two
+    // pairs of sums halve the chain of dependent additions
+    cmplx gather_dot_scalar(const cmplx *w, const uint32_t *columns, const cmplx *x, size_t n)
+    {
+        const scalar *pw = reinterpret_cast<const scalar *>(w);
+        const scalar *px = reinterpret_cast<const scalar *>(x);
+
+        scalar re[2] = { 0, 0 }, im[2] = { 0, 0 };
+        size_t j = 0;
+
+        for (; j + 2 <= n; j += 2) {
+            for (int u = 0; u < 2; ++u) {
+                scalar xr = px[2 * columns[j + u]], xi = px[2 * columns[j + u] + 1];
+                scalar wr = pw[2 * (j + u)], wi = pw[2 * (j + u) + 1];
+
+                re[u] += wr * xr - wi * xi;
+                im[u] += wr * xi + wi * xr;
+            }
+        }
+
+        if (j < n) {
+            scalar xr = px[2 * columns[j]], xi = px[2 * columns[j] + 1];
+
+            re[0] += pw[2 * j] * xr - pw[2 * j + 1] * xi;
+            im[0] += pw[2 * j] * xi + pw[2 * j + 1] * xr;
+        }
+
+        return cmplx(re[0] + re[1], im[0] + im[1]);
+    }
+
+    void dot2x2_scalar(const cmplx *w0, const cmplx *w1,
+                       const cmplx *x0, const cmplx *x1, size_t n, cmplx *z)
+    {
+        z[0] = dot_scalar(w0, x0, n);
+        z[1] = dot_scalar(w0, x1, n);
+        z[2] = dot_scalar(w1, x0, n);
+        z[3] = dot_scalar(w1, x1, n);
+    }
+
+    void normalize_scalar(cmplx *z, size_t n)
+    {
+        for (size_t i = 0; i < n; ++i)
+            z[i] /= std::abs(z[i]);
+    }
+
+    // atan(a) = a * sum_j ATAN_SERIES[j] * T_j(2a^2 - 1) for a in [0..1],
+    // Chebyshev series with error below 3e-10
+    const int ATAN_TERMS = 11;
+
+    const double ATAN_SERIES[ATAN_TERMS] = {
+         0.8813735870195428,    -0.10589292454670622,   0.011135842059405463,
+        -0.001381195003600365,   0.0001857429732783611, -2.621519611251566e-05,
+         3.821036594285898e-06, -5.699186166174818e-07,  8.648877866557214e-08,
+        -1.3303383956664306e-08, 2.0685057733338397e-09
+    };
+
+    // Phases closer than this to a sector border are left to
+    // klogic::sector_number(): over 3 times the series error. The float
+    // build compares with float std::arg(), which is less precise
+#ifdef KLOGIC_FLOAT
+    const double BORDER_MARGIN = 1e-6;
+#else
+    const double BORDER_MARGIN = 1e-9;
+#endif
+
+    // Phase of x+iy in [0..2pi) from the series, NaN for 0 and infinity
+    inline double series_phase(double x, double y)
+    {
+        double ax = std::fabs(x), ay = std::fabs(y);
+        double a = (ax < ay ? ax : ay) / (ax < ay ? ay : ax);
+        double u = 2 * a * a - 1;
+
+        // Clenshaw recurrence
+        double b1 = 0, b2 = 0;
+
+        for (int j = ATAN_TERMS - 1; j >= 1; --j) {
+            double b = 2 * u * b1 - b2 + ATAN_SERIES[j];
+            b2 = b1;
+            b1 = b;
+        }
+
+        double r = a * (u * b1 - b2 + ATAN_SERIES[0]);
+
+        // Back from the first octant
+        r = ay > ax ? M_PI_2 - r : r;
+        r = x < 0   ? M_PI - r   : r;
+
+        return y < 0 ? TWOPI - r : r;
+    }
+
+    // Sectors of z[0..n) for k-valued logic, -1 where series_phase()
+    // is not good enough
+    void sectors_scalar(int k, const cmplx *z, size_t n, int *sectors)
+    {
+        const scalar *pz = reinterpret_cast<const scalar *>(z);
+        double scale  = k / TWOPI;
+        double margin = BORDER_MARGIN * scale;
+
+        for (size_t i = 0; i < n; ++i) {
+            double t = series_phase(pz[2 * i], pz[2 * i + 1]) * scale;
+            double s = std::floor(t);
+
+            // False for NaN too
+            bool sure = t - s >= margin && s + 1 - t >= margin;
+
+            sectors[i] = sure ? int(s) : -1;
+        }
+    }
+
+#if defined(KLOGIC_X86_DISPATCH) && !defined(KLOGIC_FLOAT)
+    // For w = (a, b) and x = (c, d) we accumulate separately
+    //   acc_r += (a, b) * (c, c) = (ac, bc)
+    //   acc_i += (b, a) * (d, d) = (bd, ad)
+    // and combine them once at the end: (ac - bd, bc + ad).
+
+    __attribute__((target("avx2,fma")))
+    cmplx dot_avx2(const cmplx *w, const cmplx *x, size_t n)
+    {
+        const double *pw = reinterpret_cast<const double *>(w);
+        const double *px = reinterpret_cast<const double *>(x);
+
+        __m256d acc_r0 = _mm256_setzero_pd(), acc_i0 = _mm256_setzero_pd();
+        __m256d acc_r1 = _mm256_setzero_pd(), acc_i1 = _mm256_setzero_pd();
+
+        size_t i = 0, nd = 2 * n;
+
+        // 4 complex numbers per iteration, two independent chains
+        for (; i + 8 <= nd; i += 8) {
+            __m256d w0 = _mm256_loadu_pd(pw + i), w1 = _mm256_loadu_pd(pw + i + 4);
+            __m256d x0 = _mm256_loadu_pd(px + i), x1 = _mm256_loadu_pd(px + i + 4);
+
+            acc_r0 = _mm256_fmadd_pd(w0, _mm256_movedup_pd(x0), acc_r0);
+            acc_r1 = _mm256_fmadd_pd(w1, _mm256_movedup_pd(x1), acc_r1);
+            acc_i0 = _mm256_fmadd_pd(_mm256_permute_pd(w0, 0x5), _mm256_permute_pd(x0, 0xF), acc_i0);
+            acc_i1 = _mm256_fmadd_pd(_mm256_permute_pd(w1, 0x5), _mm256_permute_pd(x1, 0xF), acc_i1);
+        }
+
+        for (; i + 4 <= nd; i += 4) {
+            __m256d w0 = _mm256_loadu_pd(pw + i);
+            __m256d x0 = _mm256_loadu_pd(px + i);
+
+            acc_r0 = _mm256_fmadd_pd(w0, _mm256_movedup_pd(x0), acc_r0);
+            acc_i0 = _mm256_fmadd_pd(_mm256_permute_pd(w0, 0x5), _mm256_permute_pd(x0, 0xF), acc_i0);
+        }
+
+        __m256d acc_r = _mm256_add_pd(acc_r0, acc_r1);
+        __m256d acc_i = _mm256_add_pd(acc_i0, acc_i1);
+
+        // (ac - bd, bc + ad) for both lanes, then sum lanes
+        __m256d acc = _mm256_addsub_pd(acc_r, acc_i);
+        __m128d sum = _mm_add_pd(_mm256_castpd256_pd128(acc), _mm256_extractf128_pd(acc, 1));
+
+        double re = _mm_cvtsd_f64(sum);
+        double im = _mm_cvtsd_f64(_mm_unpackhi_pd(sum, sum));
+
+        // At most one complex number left
+        if (i < nd) {
+            re += pw[i] * px[i]     - pw[i + 1] * px[i + 1];
+            im += pw[i] * px[i + 1] + pw[i + 1] * px[i];
+        }
+
+        return cmplx(re, im);
+    }
+
+    // Sum of lanes of addsub(acc_r, acc_i), see above
+    __attribute__((target("avx2,fma")))
+    inline cmplx combine_avx2(__m256d acc_r, __m256d acc_i)
+    {
+        __m256d acc = _mm256_addsub_pd(acc_r, acc_i);
+        __m128d sum = _mm_add_pd(_mm256_castpd256_pd128(acc), _mm256_extractf128_pd(acc, 1));
+
+        return cmplx(_mm_cvtsd_f64(sum), _mm_cvtsd_f64(_mm_unpackhi_pd(sum, sum)));
+    }
+
+    __attribute__((target("avx2,fma")))
+    void dot2x2_avx2(const cmplx *w0, const cmplx *w1,
+                     const cmplx *x0, const cmplx *x1, size_t n, cmplx *z)
+    {
+        const double *pw0 = reinterpret_cast<const double *>(w0);
+        const double *pw1 = reinterpret_cast<const double *>(w1);
+        const double *px0 = reinterpret_cast<const double *>(x0);
+        const double *px1 = reinterpret_cast<const double *>(x1);
+
+        __m256d r00 = _mm256_setzero_pd(), i00 = _mm256_setzero_pd();
+        __m256d r01 = _mm256_setzero_pd(), i01 = _mm256_setzero_pd();
+        __m256d r10 = _mm256_setzero_pd(), i10 = _mm256_setzero_pd();
+        __m256d r11 = _mm256_setzero_pd(), i11 = _mm256_setzero_pd();
+
+        size_t i = 0, nd = 2 * n;
+
+        // Each loaded weight is used for two inputs and vice versa
+        for (; i + 4 <= nd; i += 4) {
+            __m256d a0 = _mm256_loadu_pd(pw0 + i), a1 = _mm256_loadu_pd(pw1 + i);
+            __m256d b0 = _mm256_loadu_pd(px0 + i), b1 = _mm256_loadu_pd(px1 + i);
+
+            __m256d s0  = _mm256_permute_pd(a0, 0x5), s1  = _mm256_permute_pd(a1, 0x5);
+            __m256d re0 = _mm256_movedup_pd(b0),      re1 = _mm256_movedup_pd(b1);
+            __m256d im0 = _mm256_permute_pd(b0, 0xF), im1 = _mm256_permute_pd(b1, 0xF);
+
+            r00 = _mm256_fmadd_pd(a0, re0, r00); i00 = _mm256_fmadd_pd(s0, im0, i00);
+            r01 = _mm256_fmadd_pd(a0, re1, r01); i01 = _mm256_fmadd_pd(s0, im1, i01);
+            r10 = _mm256_fmadd_pd(a1, re0, r10); i10 = _mm256_fmadd_pd(s1, im0, i10);
+            r11 = _mm256_fmadd_pd(a1, re1, r11); i11 = _mm256_fmadd_pd(s1, im1, i11);
+        }
+
+        z[0] = combine_avx2(r00, i00);
+        z[1] = combine_avx2(r01, i01);
+        z[2] = combine_avx2(r10, i10);
+        z[3] = combine_avx2(r11, i11);
+
+        // At most one complex number left
+        if (i < nd) {
+            size_t k = i / 2;
+
+            z[0] += dot_scalar(w0 + k, x0 + k, 1);
+            z[1] += dot_scalar(w0 + k, x1 + k, 1);
+            z[2] += dot_scalar(w1 + k, x0 + k, 1);
+            z[3] += dot_scalar(w1 + k, x1 + k, 1);
+        }
+    }
+
+    __attribute__((target("avx2,fma")))
+    void normalize_avx2(cmplx *z, size_t n)
+    {
+        double *pz = reinterpret_cast<double *>(z);
+        size_t i = 0, nd = 2 * n;
+
+        for (; i + 4 <= nd; i += 4) {
+            __m256d v  = _mm256_loadu_pd(pz + i);
+            __m256d sq = _mm256_mul_pd(v, v);
+
+            // |z|^2 in both lanes of each number
+            __m256d norm = _mm256_sqrt_pd(_mm256_add_pd(sq, _mm256_permute_pd(sq, 0x5)));
+
+            _mm256_storeu_pd(pz + i, _mm256_div_pd(v, norm));
+        }
+
+        if (i < nd)
+            normalize_scalar(z + i / 2, 1);
+    }
+
+    // The same as sectors_scalar() for 4 numbers at once
+    __attribute__((target("avx2,fma")))
+    void sectors_avx2(int k, const cmplx *z, size_t n, int *sectors)
+    {
+        const double *pz = reinterpret_cast<const double *>(z);
+
+        const __m256d scale  = _mm256_set1_pd(k / TWOPI);
+        const __m256d margin = _mm256_set1_pd(BORDER_MARGIN * (k / TWOPI));
+        const __m256d zero   = _mm256_setzero_pd();
+        const __m256d one    = _mm256_set1_pd(1.0);
+        const __m256d two    = _mm256_set1_pd(2.0);
+        const __m256d sign   = _mm256_set1_pd(-0.0);
+        const __m256d unsure = _mm256_set1_pd(-1.0);
+
+        size_t i = 0;
+
+        for (; i + 4 <= n; i += 4) {
+            __m256d v0 = _mm256_loadu_pd(pz + 2 * i);
+            __m256d v1 = _mm256_loadu_pd(pz + 2 * i + 4);
+
+            // Deinterleave to (x0, x1, x2, x3) and (y0, y1, y2, y3)
+            __m256d x = _mm256_permute4x64_pd(_mm256_unpacklo_pd(v0, v1), 0xD8);
+            __m256d y = _mm256_permute4x64_pd(_mm256_unpackhi_pd(v0, v1), 0xD8);
+
+            __m256d ax = _mm256_andnot_pd(sign, x);
+            __m256d ay = _mm256_andnot_pd(sign, y);
+
+            __m256d a  = _mm256_div_pd(_mm256_min_pd(ax, ay), _mm256_max_pd(ax, ay));
+            __m256d u  = _mm256_fmsub_pd(_mm256_mul_pd(two, a), a, one);
+            __m256d u2 = _mm256_mul_pd(two, u);
+
+            // Clenshaw recurrence
+            __m256d b1 = zero, b2 = zero;
+
+            for (int j = ATAN_TERMS - 1; j >= 1; --j) {
+                __m256d b = _mm256_fmadd_pd(u2, b1, _mm256_sub_pd(_mm256_set1_pd(ATAN_SERIES[j]), b2));
+                b2 = b1;
+                b1 = b;
+            }
+
+            __m256d r = _mm256_mul_pd(a, _mm256_fmadd_pd(u, b1,
+                            _mm256_sub_pd(_mm256_set1_pd(ATAN_SERIES[0]), b2)));
+
+            // Back from the first octant
+            r = _mm256_blendv_pd(r, _mm256_sub_pd(_mm256_set1_pd(M_PI_2), r),
+                                 _mm256_cmp_pd(ay, ax, _CMP_GT_OQ));
+            r = _mm256_blendv_pd(r, _mm256_sub_pd(_mm256_set1_pd(M_PI), r),
+                                 _mm256_cmp_pd(x, zero, _CMP_LT_OQ));
+            r = _mm256_blendv_pd(r, _mm256_sub_pd(_mm256_set1_pd(TWOPI), r),
+                                 _mm256_cmp_pd(y, zero, _CMP_LT_OQ));
+
+            __m256d t = _mm256_mul_pd(r, scale);
+            __m256d s = _mm256_floor_pd(t);
+
+            __m256d sure = _mm256_and_pd(
+                _mm256_cmp_pd(_mm256_sub_pd(t, s), margin, _CMP_GE_OQ),
+                _mm256_cmp_pd(_mm256_sub_pd(_mm256_add_pd(s, one), t), margin, _CMP_GE_OQ));
+
+            // min/max drop NaNs, so NaN inputs are checked separately
+            sure = _mm256_andnot_pd(_mm256_cmp_pd(x, y, _CMP_UNORD_Q), sure);
+
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(sectors + i),
+                             _mm256_cvtpd_epi32(_mm256_blendv_pd(unsure, s, sure)));
+        }
+
+        if (i < n)
+            sectors_scalar(k, z + i, n - i, sectors + i);
+    }
+
+    __attribute__((target("avx512f")))
+    cmplx dot_avx512(const cmplx *w, const cmplx *x, size_t n)
+    {
+        const double *pw = reinterpret_cast<const double *>(w);
+        const double *px = reinterpret_cast<const double *>(x);
+
+        __m512d acc_r0 = _mm512_setzero_pd(), acc_i0 = _mm512_setzero_pd();
+        __m512d acc_r1 = _mm512_setzero_pd(), acc_i1 = _mm512_setzero_pd();
+
+        size_t i = 0, nd = 2 * n;
+
+        // 8 complex numbers per iteration, two independent chains
+        for (; i + 16 <= nd; i += 16) {
+            __m512d w0 = _mm512_loadu_pd(pw + i), w1 = _mm512_loadu_pd(pw + i + 8);
+            __m512d x0 = _mm512_loadu_pd(px + i), x1 = _mm512_loadu_pd(px + i + 8);
+
+            acc_r0 = _mm512_fmadd_pd(w0, _mm512_movedup_pd(x0), acc_r0);
+            acc_r1 = _mm512_fmadd_pd(w1, _mm512_movedup_pd(x1), acc_r1);
+            acc_i0 = _mm512_fmadd_pd(_mm512_permute_pd(w0, 0x55), _mm512_permute_pd(x0, 0xFF), acc_i0);
+            acc_i1 = _mm512_fmadd_pd(_mm512_permute_pd(w1, 0x55), _mm512_permute_pd(x1, 0xFF), acc_i1);
+        }
+
+        // Tail of up to 7 complex numbers: masked loads give zeros
+        for (; i < nd; i += 8) {
+            __mmask8 mask = (nd - i >= 8) ? 0xFF : __mmask8((1u << (nd - i)) - 1);
+
+            __m512d w0 = _mm512_maskz_loadu_pd(mask, pw + i);
+            __m512d x0 = _mm512_maskz_loadu_pd(mask, px + i);
+
+            acc_r0 = _mm512_fmadd_pd(w0, _mm512_movedup_pd(x0), acc_r0);
+            acc_i0 = _mm512_fmadd_pd(_mm512_permute_pd(w0, 0x55), _mm512_permute_pd(x0, 0xFF), acc_i0);
+        }
+
+        __m512d acc_r = _mm512_add_pd(acc_r0, acc_r1);
+        __m512d acc_i = _mm512_add_pd(acc_i0, acc_i1);
+
+        // Even lanes hold real parts, odd lanes hold imaginary ones
+        double re = _mm512_mask_reduce_add_pd(0x55, acc_r) - _mm512_mask_reduce_add_pd(0x55, acc_i);
+        double im = _mm512_mask_reduce_add_pd(0xAA, acc_r) + _mm512_mask_reduce_add_pd(0xAA, acc_i);
+
+        return cmplx(re, im);
+    }
+    __attribute__((target("avx512f")))
+    inline cmplx combine_avx512(__m512d acc_r, __m512d acc_i)
+    {
+        return cmplx(_mm512_mask_reduce_add_pd(0x55, acc_r) - _mm512_mask_reduce_add_pd(0x55, acc_i),
+                     _mm512_mask_reduce_add_pd(0xAA, acc_r) + _mm512_mask_reduce_add_pd(0xAA, acc_i));
+    }
+
+    __attribute__((target("avx512f")))
+    void dot2x2_avx512(const cmplx *w0, const cmplx *w1,
+                       const cmplx *x0, const cmplx *x1, size_t n, cmplx *z)
+    {
+        const double *pw0 = reinterpret_cast<const double *>(w0);
+        const double *pw1 = reinterpret_cast<const double *>(w1);
+        const double *px0 = reinterpret_cast<const double *>(x0);
+        const double *px1 = reinterpret_cast<const double *>(x1);
+
+        __m512d r00 = _mm512_setzero_pd(), i00 = _mm512_setzero_pd();
+        __m512d r01 = _mm512_setzero_pd(), i01 = _mm512_setzero_pd();
+        __m512d r10 = _mm512_setzero_pd(), i10 = _mm512_setzero_pd();
+        __m512d r11 = _mm512_setzero_pd(), i11 = _mm512_setzero_pd();
+
+        size_t nd = 2 * n;
+
+        // Each loaded weight is used for two inputs and vice versa. Tail
+        // is done with masked loads
+        for (size_t i = 0; i < nd; i += 8) {
+            __mmask8 mask = (nd - i >= 8) ? 0xFF : __mmask8((1u << (nd - i)) - 1);
+
+            __m512d a0 = _mm512_maskz_loadu_pd(mask, pw0 + i), a1 = _mm512_maskz_loadu_pd(mask, pw1 + i);
+            __m512d b0 = _mm512_maskz_loadu_pd(mask, px0 + i), b1 = _mm512_maskz_loadu_pd(mask, px1 + i);
+
+            __m512d s0  = _mm512_permute_pd(a0, 0x55), s1  = _mm512_permute_pd(a1, 0x55);
+            __m512d re0 = _mm512_movedup_pd(b0),       re1 = _mm512_movedup_pd(b1);
+            __m512d im0 = _mm512_permute_pd(b0, 0xFF), im1 = _mm512_permute_pd(b1, 0xFF);
+
+            r00 = _mm512_fmadd_pd(a0, re0, r00); i00 = _mm512_fmadd_pd(s0, im0, i00);
+            r01 = _mm512_fmadd_pd(a0, re1, r01); i01 = _mm512_fmadd_pd(s0, im1, i01);
+            r10 = _mm512_fmadd_pd(a1, re0, r10); i10 = _mm512_fmadd_pd(s1, im0, i10);
+            r11 = _mm512_fmadd_pd(a1, re1, r11); i11 = _mm512_fmadd_pd(s1, im1, i11);
+        }
+
+        z[0] = combine_avx512(r00, i00);
+        z[1] = combine_avx512(r01, i01);
+        z[2] = combine_avx512(r10, i10);
+        z[3] = combine_avx512(r11, i11);
+    }
+
+    // Gathered dot product: a complex number is 16 bytes, so two of
+    // them are gathered with two 128-bit loads into one register and
+    // then multiplied as in dot_avx2
+    __attribute__((target("avx2,fma")))
+    cmplx gather_dot_avx2(const cmplx *w, const uint32_t *columns, const cmplx *x, size_t n)
+    {
+        const double *pw = reinterpret_cast<const double *>(w);
+        const double *px = reinterpret_cast<const double *>(x);
+
+        __m256d acc_r0 = _mm256_setzero_pd(), acc_i0 = _mm256_setzero_pd();
+        __m256d acc_r1 = _mm256_setzero_pd(), acc_i1 = _mm256_setzero_pd();
+
+        size_t j = 0;
+
+        for (; j + 4 <= n; j += 4) {
+            __m256d w0 = _mm256_loadu_pd(pw + 2 * j), w1 = _mm256_loadu_pd(pw + 2 * j + 4);
+            __m256d x0 = _mm256_insertf128_pd(_mm256_castpd128_pd256(_mm_loadu_pd(px + 2 * columns[j])),
+                                              _mm_loadu_pd(px + 2 * columns[j + 1]), 1);
+            __m256d x1 = _mm256_insertf128_pd(_mm256_castpd128_pd256(_mm_loadu_pd(px + 2 * columns[j + 2])),
+                                              _mm_loadu_pd(px + 2 * columns[j + 3]), 1);
+
+            acc_r0 = _mm256_fmadd_pd(w0, _mm256_movedup_pd(x0), acc_r0);
+            acc_r1 = _mm256_fmadd_pd(w1, _mm256_movedup_pd(x1), acc_r1);
+            acc_i0 = _mm256_fmadd_pd(_mm256_permute_pd(w0, 0x5), _mm256_permute_pd(x0, 0xF), acc_i0);
+            acc_i1 = _mm256_fmadd_pd(_mm256_permute_pd(w1, 0x5), _mm256_permute_pd(x1, 0xF), acc_i1);
+        }
+
+        __m256d acc = _mm256_addsub_pd(_mm256_add_pd(acc_r0, acc_r1), _mm256_add_pd(acc_i0, acc_i1));
+        __m128d sum = _mm_add_pd(_mm256_castpd256_pd128(acc), _mm256_extractf128_pd(acc, 1));
+
+        double re = _mm_cvtsd_f64(sum);
+        double im = _mm_cvtsd_f64(_mm_unpackhi_pd(sum, sum));
+
+        // At most 3 weights left. Kept here rather than calling
+        // gather_dot_scalar(): SSE code after AVX one with dirty upper
+        // halves of registers is slow
+        for (; j < n; ++j) {
+            double xr = px[2 * columns[j]], xi = px[2 * columns[j] + 1];
+
+            re += pw[2 * j] * xr - pw[2 * j + 1] * xi;
+            im += pw[2 * j] * xi + pw[2 * j + 1] * xr;
+        }
+
+        return cmplx(re, im);
+    }
+
+#endif
+
+#if defined(KLOGIC_X86_DISPATCH) && defined(KLOGIC_FLOAT)
+    // Float build: the same scheme as the double dot_avx2 with 4 complex
+    // numbers per register. Normalize and sectors stay scalar: the
+    // vector sector series is written for doubles only
+
+    __attribute__((target("avx2,fma")))
+    cmplx dot_avx2(const cmplx *w, const cmplx *x, size_t n)
+    {
+        const float *pw = reinterpret_cast<const float *>(w);
+        const float *px = reinterpret_cast<const float *>(x);
+
+        __m256 acc_r0 = _mm256_setzero_ps(), acc_i0 = _mm256_setzero_ps();
+        __m256 acc_r1 = _mm256_setzero_ps(), acc_i1 = _mm256_setzero_ps();
+
+        size_t i = 0, nd = 2 * n;
+
+        // 8 complex numbers per iteration, two independent chains
+        for (; i + 16 <= nd; i += 16) {
+            __m256 w0 = _mm256_loadu_ps(pw + i), w1 = _mm256_loadu_ps(pw + i + 8);
+            __m256 x0 = _mm256_loadu_ps(px + i), x1 = _mm256_loadu_ps(px + i + 8);
+
+            acc_r0 = _mm256_fmadd_ps(w0, _mm256_moveldup_ps(x0), acc_r0);
+            acc_r1 = _mm256_fmadd_ps(w1, _mm256_moveldup_ps(x1), acc_r1);
+            acc_i0 = _mm256_fmadd_ps(_mm256_permute_ps(w0, 0xB1), _mm256_movehdup_ps(x0), acc_i0);
+            acc_i1 = _mm256_fmadd_ps(_mm256_permute_ps(w1, 0xB1), _mm256_movehdup_ps(x1), acc_i1);
+        }
+
+        for (; i + 8 <= nd; i += 8) {
+            __m256 w0 = _mm256_loadu_ps(pw + i);
+            __m256 x0 = _mm256_loadu_ps(px + i);
+
+            acc_r0 = _mm256_fmadd_ps(w0, _mm256_moveldup_ps(x0), acc_r0);
+            acc_i0 = _mm256_fmadd_ps(_mm256_permute_ps(w0, 0xB1), _mm256_movehdup_ps(x0), acc_i0);
+        }
+
+        // (ac - bd, bc + ad) for 4 numbers, then sum them
+        __m256 acc = _mm256_addsub_ps(_mm256_add_ps(acc_r0, acc_r1), _mm256_add_ps(acc_i0, acc_i1));
+        __m128 sum = _mm_add_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1));
+
+        sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+
+        cmplx result(_mm_cvtss_f32(sum), _mm_cvtss_f32(_mm_shuffle_ps(sum, sum, 0x1)));
+
+        // At most 3 complex numbers left
+        return result + dot_scalar(w + i / 2, x + i / 2, n - i / 2);
+    }
+
+    __attribute__((target("avx2,fma")))
+    void dot2x2_avx2(const cmplx *w0, const cmplx *w1,
+                     const cmplx *x0, const cmplx *x1, size_t n, cmplx *z)
+    {
+        z[0] = dot_avx2(w0, x0, n);
+        z[1] = dot_avx2(w0, x1, n);
+        z[2] = dot_avx2(w1, x0, n);
+        z[3] = dot_avx2(w1, x1, n);
+    }
+#endif
+
+    // Set of kernels for one instruction set
+    struct kernel_set {
+        const char         *name;
+        dot_function        dot;
+        dot2x2_function     dot2x2;
+        normalize_function  normalize;
+        sectors_function    sectors;
+        gather_dot_function gather_dot;
+    };
+
+    std::vector<kernel_set> detect_kernel_sets()
+    {
+        std::vector<kernel_set> result;
+
+        kernel_set scalar = { "scalar", &dot_scalar, &dot2x2_scalar, &normalize_scalar,
+                                &sectors_scalar, &gather_dot_scalar };
+        result.push_back(scalar);
+
+#if defined(KLOGIC_X86_DISPATCH) && defined(KLOGIC_FLOAT)
+        __builtin_cpu_init();
+
+        if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+            kernel_set avx2 = { "avx2", &dot_avx2, &dot2x2_avx2, &normalize_scalar,
+                                  &sectors_scalar, &gather_dot_scalar };
+            result.push_back(avx2);
+        }
+#elif defined(KLOGIC_X86_DISPATCH)
+        __builtin_cpu_init();
+
+        if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+            kernel_set avx2 = { "avx2", &dot_avx2, &dot2x2_avx2, &normalize_avx2,
+                                  &sectors_avx2, &gather_dot_avx2 };
+            result.push_back(avx2);
+        }
+
+        // No AVX-512 normalize: sqrt/div throughput is the same as AVX2 one
+        // on most CPUs while clocks may go down
+        if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx2")
+                && __builtin_cpu_supports("fma")) {
+            kernel_set avx512 = { "avx512", &dot_avx512, &dot2x2_avx512, &normalize_avx2,
+                                    &sectors_avx2, &gather_dot_avx2 };
+            result.push_back(avx512);
+        }
+#endif
+
+        return result;
+    }
+
+    const kernel_set &best_kernels()
+    {
+        static const kernel_set best = detect_kernel_sets().back();
+
+        return best;
+    }
+
+    // Size of weights and inputs blocks in layer_sums(). Two such blocks
+    // should stay in L2 cache
+    const size_t BLOCK_BYTES = 128 * 1024;
+
+    // Samples per block in activate()
+    const size_t ACTIVATE_BLOCK = 256;
+
+    // Root tables by k, see roots_of_unity()
+    std::atomic<const cmplx *> root_tables[MAX_ROOTS_K + 1];
+
+    // Periodic root tables with the same number of sectors m = k*l form
+    // a list, new ones are pushed to its head. There are as many as
+    // divisors of m at most
+    struct periodic_table {
+        int k;
+        const cmplx *roots;
+        periodic_table *next;
+    };
+
+    std::atomic<periodic_table *> periodic_tables[MAX_ROOTS_K + 1];
+
+    // Sectors of a block to roots from table, as in activate()
+    void apply_roots(int m, const cmplx *roots, cmplx *z, size_t n)
+    {
+        static const sectors_function sectors_of = best_kernels().sectors;
+
+        int sectors[ACTIVATE_BLOCK];
+
+        for (size_t i0 = 0; i0 < n; i0 += ACTIVATE_BLOCK) {
+            size_t count = std::min(ACTIVATE_BLOCK, n - i0);
+            cmplx *block = z + i0;
+
+            sectors_of(m, block, count, sectors);
+
+            for (size_t i = 0; i < count; ++i) {
+                int sector = sectors[i] >= 0 ? sectors[i] : klogic::sector_number(m, block[i]);
+
+                // NaN stays NaN
+                block[i] = sector >= 0 && sector <= m ? roots[sector] : block[i] / std::abs(block[i]);
+            }
+        }
+    }
+}
+
+//-------------------------------------------------------------------------
+
+cmplx klogic::kernels::dot(const cmplx *w, const cmplx *x, size_t n)
+{
+    static const dot_function function = best_kernels().dot;
+
+    return function(w, x, n);
+}
+
+cmplx klogic::kernels::gather_dot(const cmplx *w, const uint32_t *columns, const cmplx *x,
+                                  size_t n)
+{
+    static const gather_dot_function function = best_kernels().gather_dot;
+
+    return function(w, columns, x, n);
+}
+
+const char *klogic::kernels::dot_name()
+{
+    return best_kernels().name;
+}
+
+std::vector<dot_kernel> klogic::kernels::available_dot_kernels()
+{
+    std::vector<kernel_set> sets = detect_kernel_sets();
+    std::vector<dot_kernel> result(sets.size());
+
+    for (size_t i = 0; i < sets.size(); ++i) {
+        result[i].name     = sets[i].name;
+        result[i].function = sets[i].dot;
+    }
+
+    return result;
+}
+
+//-------------------------------------------------------------------------
+
+void klogic::kernels::layer_sums(const cmplx *W, size_t rows, size_t inputs,
+                                 const cmplx *X, size_t count, cmplx *Z)
+{
+    static const dot_function    dot1 = best_kernels().dot;
+    static const dot2x2_function dot4 = best_kernels().dot2x2;
+
+    size_t stride = inputs + 1;
+
+    // Blocks of weight rows and of samples, even sizes to keep 2x2 tiles
+    size_t row_block    = std::max<size_t>(2, BLOCK_BYTES / (stride * sizeof(cmplx)) & ~size_t(1));
+    size_t sample_block = std::max<size_t>(2, BLOCK_BYTES / (stride * sizeof(cmplx)) & ~size_t(1));
+
+    for (size_t r0 = 0; r0 < rows; r0 += row_block) {
+        size_t r_end = std::min(rows, r0 + row_block);
+
+        for (size_t b0 = 0; b0 < count; b0 += sample_block) {
+            size_t b_end = std::min(count, b0 + sample_block);
+
+            for (size_t r = r0; r < r_end; r += 2) {
+                const cmplx *w0 = W + r * stride;
+
+                if (r + 1 == r_end) {
+                    // Odd row left
+                    for (size_t b = b0; b < b_end; ++b)
+                        Z[b * rows + r] = w0[0] + dot1(w0 + 1, X + b * inputs, inputs);
+
+                    continue;
+                }
+
+                const cmplx *w1 = w0 + stride;
+                size_t b = b0;
+
+                for (; b + 1 < b_end; b += 2) {
+                    cmplx z[4];
+
+                    dot4(w0 + 1, w1 + 1, X + b * inputs, X + (b + 1) * inputs, inputs, z);
+
+                    Z[b * rows + r]           = w0[0] + z[0];
+                    Z[(b + 1) * rows + r]     = w0[0] + z[1];
+                    Z[b * rows + r + 1]       = w1[0] + z[2];
+                    Z[(b + 1) * rows + r + 1] = w1[0] + z[3];
+                }
+
+                if (b < b_end) {
+                    // Odd sample left
+                    Z[b * rows + r]     = w0[0] + dot1(w0 + 1, X + b * inputs, inputs);
+                    Z[b * rows + r + 1] = w1[0] + dot1(w1 + 1, X + b * inputs, inputs);
+                }
+            }
+        }
+    }
+}
+
+void klogic::kernels::add_conj_scaled(cmplx *w, const cmplx &a, const cmplx *x, size_t n)
+{
+    // Plain loop on scalars is vectorized by compiler well enough, while
+    // std::complex multiplication is not
+    scalar       *pw = reinterpret_cast<scalar *>(w);
+    const scalar *px = reinterpret_cast<const scalar *>(x);
+    scalar p = a.real(), q = a.imag();
+
+    for (size_t i = 0; i < 2 * n; i += 2) {
+        pw[i]     += p * px[i] + q * px[i + 1];
+        pw[i + 1] += q * px[i] - p * px[i + 1];
+    }
+}
+
+void klogic::kernels::add_scaled(cmplx *y, const cmplx &a, const cmplx *x, size_t n)
+{
+    // See add_conj_scaled()
+    scalar       *py = reinterpret_cast<scalar *>(y);
+    const scalar *px = reinterpret_cast<const scalar *>(x);
+    scalar p = a.real(), q = a.imag();
+
+    for (size_t i = 0; i < 2 * n; i += 2) {
+        py[i]     += p * px[i] - q * px[i + 1];
+        py[i + 1] += q * px[i] + p * px[i + 1];
+    }
+}
+
+void klogic::kernels::reciprocals(const cmplx *w, cmplx *r, size_t n)
+{
+    const scalar *pw = reinterpret_cast<const scalar *>(w);
+    scalar       *pr = reinterpret_cast<scalar *>(r);
+
+    // Zero weights (pruned ones) get zero, so they take no part in error
+    // backpropagation
+    for (size_t i = 0; i < 2 * n; i += 2) {
+        scalar d = pw[i] * pw[i] + pw[i + 1] * pw[i + 1];
+
+        pr[i]     = d > 0 ?  pw[i] / d : 0;
+        pr[i + 1] = d > 0 ? -pw[i + 1] / d : 0;
+    }
+}
+
+void klogic::kernels::normalize(cmplx *z, size_t n)
+{
+    static const normalize_function function = best_kernels().normalize;
+
+    function(z, n);
+}
+
+const cmplx *klogic::kernels::roots_of_unity(int k)
+{
+    if (k <= 0 || k > MAX_ROOTS_K)
+        return 0;
+
+    const cmplx *table = root_tables[k].load(std::memory_order_acquire);
+
+    if (table)
+        return table;
+
+    // The same calculation as epsilon(), without its n < k assertion
+    cmplx *made = new cmplx[k + 1];
+
+    for (int n = 0; n <= k; ++n)
+        made[n] = std::polar(scalar(1), scalar((TWOPI * n) / k));
+
+    // Another thread may have made it already
+    if (root_tables[k].compare_exchange_strong(table, made, std::memory_order_acq_rel))
+        return made;
+
+    delete[] made;
+
+    return table;
+}
+
+int klogic::kernels::sector_number(int k, const cmplx &z)
+{
+    int sector;
+
+    sectors_scalar(k, &z, 1, &sector);
+
+    return sector >= 0 ? sector : klogic::sector_number(k, z);
+}
+
+void klogic::kernels::sectors(int k, const cmplx *z, size_t n, int *sectors)
+{
+    static const sectors_function sectors_of = best_kernels().sectors;
+
+    sectors_of(k, z, n, sectors);
+
+    for (size_t i = 0; i < n; ++i) {
+        if (sectors[i] < 0)
+            sectors[i] = klogic::sector_number(k, z[i]);
+    }
+}
+
+cmplx klogic::kernels::activation(int k, const cmplx &z)
+{
+    const cmplx *roots = roots_of_unity(k);
+
+    if (!roots)
+        return klogic::activation(k, z);
+
+    int sector = kernels::sector_number(k, z);
+
+    // Only NaN gets no sector
+    return sector >= 0 && sector <= k ? roots[sector] : klogic::activation(k, z);
+}
+
+void klogic::kernels::activate(int k, cmplx *z, size_t n)
+{
+    if (k == 0) {
+        normalize(z, n);
+        return;
+    }
+
+    const cmplx *roots = roots_of_unity(k);
+
+    if (!roots) {
+        for (size_t i = 0; i < n; ++i)
+            z[i] = klogic::activation(k, z[i]);
+
+        return;
+    }
+
+    apply_roots(k, roots, z, n);
+}
+
+const cmplx *klogic::kernels::periodic_roots(int k, int l)
+{
+    if (l == 1)
+        return roots_of_unity(k);
+
+    if (k <= 0 || l <= 0 || k > MAX_ROOTS_K / l)
+        return 0;
+
+    int m = k * l;
+    periodic_table *head = periodic_tables[m].load(std::memory_order_acquire);
+
+    for (periodic_table *t = head; t; t = t->next) {
+        if (t->k == k)
+            return t->roots;
+    }
+
+    const cmplx *roots = roots_of_unity(k);
+    cmplx *made = new cmplx[m + 1];
+
+    for (int s = 0; s < m; ++s)
+        made[s] = roots[s % k];
+
+    made[m] = roots[k];
+
+    periodic_table *node = new periodic_table;
+
+    node->k     = k;
+    node->roots = made;
+    node->next  = head;
+
+    // Another thread may have pushed a table meanwhile, possibly this one
+    while (!periodic_tables[m].compare_exchange_weak(node->next, node, std::memory_order_acq_rel)) {
+        for (periodic_table *t = node->next; t; t = t->next) {
+            if (t->k == k) {
+                delete[] made;
+                delete node;
+
+                return t->roots;
+            }
+        }
+    }
+
+    return made;
+}
+
+cmplx klogic::kernels::periodic_activation(int k, int l, const cmplx &z)
+{
+    const cmplx *roots = periodic_roots(k, l);
+
+    assert(roots);
+
+    int sector = kernels::sector_number(k * l, z);
+
+    return sector >= 0 && sector <= k * l ? roots[sector] : z / std::abs(z);
+}
+
+void klogic::kernels::activate_periodic(int k, int l, cmplx *z, size_t n)
+{
+    const cmplx *roots = periodic_roots(k, l);
+
+    assert(roots);
+
+    apply_roots(k * l, roots, z, n);
+}
@@ -0,0 +1,117 @@
+// Low-level numeric kernels working on packed complex arrays
+#pragma once
+
+#include <cstddef>
+#include <stdint.h>
+#include <vector>
+#include "klogic.h"
+
+namespace klogic {
+    namespace kernels {
+        typedef cmplx (*dot_function)(const cmplx *w, const cmplx *x, size_t n);
+
+        // Four dot products at once: z = { w0.x0, w0.x1, w1.x0, w1.x1 }
+        typedef void (*dot2x2_function)(const cmplx *w0, const cmplx *w1,
+                                        const cmplx *x0, const cmplx *x1,
+                                        size_t n, cmplx *z);
+
+        // Dot product with x gathered: w[0]*x[columns[0]]+...
+        typedef cmplx (*gather_dot_function)(const cmplx *w, const uint32_t *columns,
+                                             const cmplx *x, size_t n);
+
+        typedef void (*normalize_function)(cmplx *z, size_t n);
+
+        // Sectors of z[0..n) or -1 where unsure, see sector_number()
+        typedef void (*sectors_function)(int k, const cmplx *z, size_t n, int *sectors);
+
+        struct dot_kernel {
+            const char  *name;
+            dot_function function;
+        };
+
+        // Calculates w_0*x_0+...+w_{n-1}*x_{n-1}. Implementation is picked
+        // at first call depending on CPU features (AVX-512, AVX2+FMA or
+        // plain scalar code). Arrays are used as is, i.e. interleaved
+        // real and imaginary parts; SIMD versions split them in registers
+        cmplx dot(const cmplx *w, const cmplx *x, size_t n);
+
+        // w_0*x_{columns[0]}+...+w_{n-1}*x_{columns[n-1]}, i.e. dot() for
+        // a row of a sparse (CSR) matrix. Picked like dot()
+        cmplx gather_dot(const cmplx *w, const uint32_t *columns, const cmplx *x, size_t n);
+
+        // Name of dot() implementation used on this CPU
+        const char *dot_name();
+
+        // All dot() implementations runnable on this CPU, scalar one goes
+        // first and the one dot() uses goes last
+        std::vector<dot_kernel> available_dot_kernels();
+
+        // w[i] += a * conj(x[i]) for i in [0..n), i.e. MVN weights
+        // correction
+        void add_conj_scaled(cmplx *w, const cmplx &a, const cmplx *x, size_t n);
+
+        // y[i] += a * x[i] for i in [0..n)
+        void add_scaled(cmplx *y, const cmplx &a, const cmplx *x, size_t n);
+
+        // r[i] = 1 / w[i] for i in [0..n), calculated as conj(w)/|w|^2.
+        // Zero weights get zero
+        void reciprocals(const cmplx *w, cmplx *r, size_t n);
+
+        // Weighted sums of a whole layer for a block of samples (complex
+        // GEMM). W is packed as in mlmvn::layer_weights(): `rows` rows of
+        // inputs+1 weights with bias first. X holds `count` samples of
+        // `inputs` values one after another. Result goes to Z, `rows`
+        // values per sample:
+        //   Z[b*rows + r] = W[r][0] + sum_i W[r][i+1] * X[b*inputs + i]
+        // Weights and samples are processed in cache-sized blocks and 2x2
+        // register tiles, so each loaded value is used twice
+        void layer_sums(const cmplx *W, size_t rows, size_t inputs,
+                        const cmplx *X, size_t count, cmplx *Z);
+
+        // z[i] /= |z[i]| for all i, i.e. continuous activation
+        void normalize(cmplx *z, size_t n);
+
+        // k+1 roots of unity for k-valued logic: roots[n] == epsilon(n, k)
+        // bit for bit. Extra roots[k] is what epsilon() gives for sector k,
+        // which sector_number() returns when phase rounds up to 2pi.
+        // Tables are built on first use and kept. Returns 0 for k out of
+        // [1..MAX_ROOTS_K]
+        const int MAX_ROOTS_K = 1 << 14;
+
+        const cmplx *roots_of_unity(int k);
+
+        // Same as klogic::sector_number(), but phase comes from a
+        // polynomial instead of atan2. Results are exact: values within
+        // the polynomial's error of a sector border are classified by
+        // sector_number() itself
+        int sector_number(int k, const cmplx &z);
+
+        // sectors[i] = sector_number(k, z[i]) for all i, vectorized like
+        // activate()
+        void sectors(int k, const cmplx *z, size_t n, int *sectors);
+
+        // Same as klogic::activation() with sector_number() above and
+        // roots_of_unity() instead of std::polar
+        cmplx activation(int k, const cmplx &z);
+
+        // z[i] = activation(k, z[i]) for all i. Phases of a block are
+        // calculated in one vectorizable loop first
+        void activate(int k, cmplx *z, size_t n);
+
+        // Roots for periodic activation (MVN-P) with l periods: k*l+1
+        // values, table[s] is the output for sector s of k*l sectors,
+        // i.e. roots_of_unity(k)[s % k] (table[k*l] for phase rounding
+        // up to 2pi is roots_of_unity(k)[k]). l == 1 gives
+        // roots_of_unity(k) itself. Built on first use and kept. Returns
+        // 0 for k*l out of [1..MAX_ROOTS_K]
+        const cmplx *periodic_roots(int k, int l);
+
+        // Periodic activation: output for the sector of z among k*l
+        // sectors, looked up in periodic_roots()
+        cmplx periodic_activation(int k, int l, const cmplx &z);
+
+        // z[i] = periodic_activation(k, l, z[i]) for all i, vectorized
+        // like activate()
+        void activate_periodic(int k, int l, cmplx *z, size_t n);
+    }
+}
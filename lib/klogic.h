@@ -7,7 +7,15 @@
 #include <vector>
 
 namespace klogic {
-    typedef std::complex<double> cmplx;
+    // Real type of the library. Build with KLOGIC_FLOAT defined (see
+    // mvn_float library target) to get single precision networks
+#ifdef KLOGIC_FLOAT
+    typedef float scalar;
+#else
+    typedef double scalar;
+#endif
+
+    typedef std::complex<scalar> cmplx;
     typedef std::vector<cmplx> cvector;
 
     const double TWOPI = 2 * M_PI;
@@ -18,7 +26,7 @@ namespace klogic {
 
         double phase = (TWOPI * n) / k;
 
-        return std::polar(1.0, phase);
+        return std::polar(scalar(1), scalar(phase));
     }
 
     // phase in [0..2pi) range
@@ -1,9 +1,19 @@
 #pragma once
 
 #include <algorithm>
+#include <chrono>
+#include <functional>
+#include <iterator>
+#include <stdexcept>
+#include <utility>
 #include <vector>
 #include <cassert>
 #include "mvn.h"
+#include "profile.h"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 namespace klogic {
     namespace learning {
@@ -33,7 +43,8 @@ namespace klogic {
         template<>
         class learn_error<cvector> {
         public:
-            cvector operator()(const cvector &output, const cvector &sample) const {
+            // sample may be a cvector or a view (see dataset.h)
+            cvector operator()(const cvector &output, const_cspan sample) const {
                 assert(output.size() == sample.size());
                 cvector errors(output.size());
 
@@ -54,84 +65,457 @@ namespace klogic {
 
         // ------------------
 
+        // Learners may have workspace_type (see mlmvn): scratch data of
+        // forward pass and learning kept out of the learner. Then teacher
+        // learns with its own workspace and each thread evaluating the
+        // learner has another one, so one learner may be shared. Other
+        // learners get no_workspace
+        struct no_workspace {
+            template<typename Learner>
+            no_workspace(const Learner &) {}
+
+            // Only learn_calls and skipped_samples are counted
+            learning_profile profile;
+        };
+
+        template<typename T>
+        struct always_void { typedef void type; };
+
+        template<typename Learner, typename = void>
+        struct learner_workspace {
+            typedef no_workspace type;
+        };
+
+        template<typename Learner>
+        struct learner_workspace<Learner, typename always_void<typename Learner::workspace_type>::type> {
+            typedef typename Learner::workspace_type type;
+        };
+
+        // Learners with workspace get actual output with forward(X, ws),
+        // which doesn't allocate, and learning reuses that pass. Other
+        // learners get output() and learn()
+        template<typename Learner, typename Input, typename Workspace>
+        auto forward_output(const Learner &learner, const Input &X, Workspace &ws, int)
+            -> decltype(learner.forward(X, ws)) {
+            return learner.forward(X, ws);
+        }
+
+        template<typename Learner, typename Input, typename Workspace>
+        typename Learner::desired_type forward_output(const Learner &learner, const Input &X,
+                                                      Workspace &, long) {
+            return learner.output(X);
+        }
+
+        template<typename Learner, typename Input, typename Error, typename Workspace>
+        auto learn_forwarded(Learner &learner, const Input &X, const Error &error, Workspace &ws, int)
+            -> decltype(learner.learn_forwarded(X, error, 1.0, ws)) {
+            return learner.learn_forwarded(X, error, 1.0, ws);
+        }
+
+        template<typename Learner, typename Input, typename Error, typename Workspace>
+        void learn_forwarded(Learner &learner, const Input &X, const Error &error, Workspace &, long) {
+            learner.learn(X, error);
+        }
+
+        template<typename Learner, typename Input, typename Error, typename Workspace, typename Gradient>
+        auto accumulate_forwarded(const Learner &learner, const Input &X, const Error &error,
+                                  Workspace &ws, Gradient &g, int)
+            -> decltype(learner.accumulate(X, error, 1.0, ws, g)) {
+            return learner.accumulate(X, error, 1.0, ws, g);
+        }
+
+        template<typename Learner, typename Input, typename Error, typename Workspace, typename Gradient>
+        void accumulate_forwarded(const Learner &learner, const Input &X, const Error &error,
+                                  Workspace &, Gradient &g, long) {
+            learner.accumulate(X, error, g);
+        }
+
+        // ------------------
+
+        // Observer of learning runs doing nothing, see teacher::learn_run()
+        struct no_observer {
+            template<typename Sample, typename Actual>
+            void operator()(const Sample &, const Actual &) {}
+        };
+
+        // Observer collecting metrics of a learning run. Each sample is
+        // measured on the output of the forward pass made for learning,
+        // i.e. with weights before its own correction. So this is an
+        // estimate made on the fly, not what teacher::mse() would say
+        // after the run
+        template<typename SquareError, typename Match>
+        class run_metrics {
+        public:
+            run_metrics(SquareError const &_sq_err = SquareError(), Match const &_match = Match())
+                : sq_err(_sq_err), match(_match), acc_error(0.0), hit_count(0), count(0) {}
+
+            template<typename Sample, typename Actual>
+            void operator()(const Sample &sample, const Actual &actual) {
+                acc_error += sq_err(sample, actual);
+
+                if (match(actual, sample.desired))
+                    ++hit_count;
+
+                ++count;
+            }
+
+            double mse() const { return count ? acc_error / count : 0.0; }
+            int hits() const { return hit_count; }
+            int samples_count() const { return count; }
+
+        private:
+            SquareError sq_err;
+            Match match;
+            double acc_error;
+            int hit_count, count;
+        };
+
+        // What teacher reports after each learning run
+        struct epoch_report {
+            epoch_report(size_t _epoch, size_t _samples, double _seconds,
+                         const learning_profile &_profile)
+                : epoch(_epoch), samples(_samples), seconds(_seconds), profile(_profile) {}
+
+            // Runs made so far, this one included
+            size_t epoch;
+
+            // Samples in the set and time of the run
+            size_t samples;
+            double seconds;
+
+            // Counters of the run, zero without KLOGIC_PROFILE
+            const learning_profile &profile;
+        };
+
+        // ------------------
+
+        // Batch learning of samples [first, last) for learners having
+        // gradient_type, accumulate() and apply() (mvn and mlmvn).
+        // Corrections are calculated with the same weights, then averaged
+        // and applied once. ws is learner's workspace (see
+        // learner_workspace), observe is called for every sample and its
+        // actual output. Returns number of samples picked
+        template<typename Learner, typename Iterator, typename SamplePicker,
+                 typename LearnError, typename Workspace, typename Observer>
+        auto learn_batch(Learner &learner, Iterator first, Iterator last,
+                         SamplePicker const &picker, LearnError const &learn_error,
+                         Workspace &ws, Observer &observe, int)
+            -> decltype(typename Learner::gradient_type(learner), size_t()) {
+            typedef typename std::iterator_traits<Iterator>::value_type Sample;
+
+            typename Learner::gradient_type gradient(learner);
+            size_t picked = 0;
+
+            for (Iterator i = first; i != last; ++i) {
+                const typename Sample::desired_type &actual =
+                    forward_output(learner, i->input, ws, 0);
+
+                observe(*i, actual);
+
+                if (picker(*i, actual)) {
+                    accumulate_forwarded(learner, i->input, learn_error(actual, i->desired),
+                                         ws, gradient, 0);
+                    ++picked;
+                } else {
+                    KLOGIC_PROFILE_ADD(ws.profile.skipped_samples, 1);
+                }
+            }
+
+            if (picked > 0)
+                learner.apply(gradient, 1.0 / picked);
+
+            return picked;
+        }
+
+        template<typename Learner, typename Iterator, typename SamplePicker,
+                 typename LearnError, typename Workspace, typename Observer>
+        size_t learn_batch(Learner &, Iterator, Iterator, SamplePicker const &, LearnError const &,
+                           Workspace &, Observer &, long) {
+            throw std::logic_error("klogic::learning::learn_batch(): learner supports online learning only");
+        }
+
+        // Batch size meaning the whole learning set, see teacher::set_batch_size()
+        const size_t FULL_BATCH = 0;
+
+        // Samples per chunk in parallel evaluation, see teacher::mse()
+        const size_t EVAL_CHUNK = 256;
+
+        // ------------------
+
+        // Non-owning view of samples stored elsewhere, e.g. in a vector
+        template<typename Sample>
+        class sample_span {
+        public:
+            typedef Sample        value_type;
+            typedef const Sample *const_iterator;
+            typedef const Sample *iterator;
+
+            sample_span() : first(0), count(0) {}
+            sample_span(const Sample *_first, size_t _count) : first(_first), count(_count) {}
+
+            // View of vector contents. Vector must not change while viewed
+            sample_span(const std::vector<Sample> &v)
+                : first(v.empty() ? 0 : &v[0]), count(v.size()) {}
+
+            const_iterator begin() const { return first; }
+            const_iterator end() const   { return first + count; }
+
+            size_t size() const { return count; }
+            bool empty() const { return count == 0; }
+
+            const Sample &operator[](size_t i) const {
+                assert(i < count);
+                return first[i];
+            }
+
+        private:
+            const Sample *first;
+            size_t count;
+        };
+
+        // ------------------
+
         template<typename Learner,          // mvn or mlmvn
                  typename Sample     = sample<typename Learner::desired_type>,
-                 typename LearnError = learn_error <typename Sample::desired_type> >
+                 typename LearnError = learn_error <typename Sample::desired_type>,
+                 // Read-only view of the learning set: random access range
+                 // of Sample, cheap to copy. Teacher never copies samples
+                 typename SampleSet  = sample_span<Sample> >
         class teacher {
         public:
-            teacher(Learner &_learner,
-                    const std::vector<Sample> &samples = std::vector<Sample>())
-                : learner(_learner), _samples(samples)
+            typedef SampleSet sample_set;
+            typedef std::function<void (const epoch_report &)> epoch_callback;
+
+            // Learning state kept by teacher, see learner_workspace
+            typedef typename learner_workspace<Learner>::type workspace_type;
+
+            teacher(Learner &_learner)
+                : learner(_learner), ws(_learner), owned(true), batch(1), threads(0), epochs(0)
+                {}
+
+            // Teacher keeps samples. Pass std::move(samples) to avoid copying
+            teacher(Learner &_learner, std::vector<Sample> samples)
+                : own_samples(std::move(samples)), _samples(own_samples),
+                  learner(_learner), ws(_learner), owned(true), batch(1), threads(0), epochs(0)
+                {}
+
+            // Teacher uses samples stored elsewhere, they must outlive it
+            teacher(Learner &_learner, const SampleSet &samples)
+                : _samples(samples), learner(_learner), ws(_learner), owned(false),
+                  batch(1), threads(0), epochs(0)
+                {}
+
+            teacher(const teacher &other)
+                : own_samples(other.own_samples),
+                  _samples(other.owned ? SampleSet(own_samples) : other._samples),
+                  learner(other.learner), ws(other.ws), owned(other.owned), batch(other.batch),
+                  threads(other.threads), epochs(other.epochs), on_epoch(other.on_epoch)
                 {}
 
-            // Add sample to the set
+            // Learning mode used by learn_run(). 1 (default) means online
+            // learning: weights are corrected after each sample. N > 1 means
+            // mini-batch learning: corrections for N samples are calculated
+            // with the same weights, averaged and applied once. FULL_BATCH
+            // makes the whole set one batch. Samples skipped by picker don't
+            // count. Learner must support batch learning unless size is 1
+            void set_batch_size(size_t size) { batch = size; }
+
+            size_t batch_size() const { return batch; }
+
+            // Threads used by hits() and mse() if the library is built
+            // with OpenMP. 0 (default) means OpenMP default, 1 makes
+            // evaluation serial
+            void set_threads(int n) { threads = n; }
+
+            int thread_count() const {
+#ifdef _OPENMP
+                return threads > 0 ? threads : omp_get_max_threads();
+#else
+                return 1;
+#endif
+            }
+
+            // Add sample to the set. If the set is borrowed, teacher makes its
+            // own copy first
             void add_sample(const Sample &sample) {
-                _samples.push_back(sample);
+                if (!owned) {
+                    own_samples.assign(_samples.begin(), _samples.end());
+                    owned = true;
+                }
+
+                own_samples.push_back(sample);
+                _samples = SampleSet(own_samples);
             }
 
-            void set_samples(const std::vector<Sample> &samples) {
+            // Replace the set, see constructors
+            void set_samples(std::vector<Sample> samples) {
+                own_samples = std::move(samples);
+                _samples = SampleSet(own_samples);
+                owned = true;
+            }
+
+            void set_samples(const SampleSet &samples) {
+                own_samples.clear();
                 _samples = samples;
+                owned = false;
             }
 
             // Learning set
-            const std::vector<Sample> samples() const { return _samples; }
+            const SampleSet &samples() const { return _samples; }
 
             // Learning set size
-            int samples_count() const { return samples().size(); }
+            int samples_count() const { return _samples.size(); }
 
-            // How well learner matches the learning set
+            // How well learner matches the learning set. Samples are
+            // evaluated in parallel (see set_threads()), so match is
+            // called from several threads at once
             template <class Match>
             int hits(Match const &match = Match()) const {
-                int count = 0;
+                typedef typename SampleSet::const_iterator iterator;
 
-                for (typename std::vector<Sample>::const_iterator i = _samples.begin();
-                        i != _samples.end(); ++i) {
-
-                    if (match(learner.output(i->input), i->desired))
-                        ++count;
-                }
-
-                return count;
+                return evaluate<int>([&](iterator i, const typename Sample::desired_type &actual) {
+                    return match(actual, i->desired) ? 1 : 0;
+                });
             }
 
             // Make a run against set. picker instance is used to skip some set items
             template <typename SamplePicker>
             void learn_run(SamplePicker const &picker = SamplePicker()) {
-                for (typename std::vector<Sample>::const_iterator i = _samples.begin();
-                        i != _samples.end(); ++i) {
+                no_observer none;
+
+                learn_run(picker, none);
+            }
 
-                    typename Sample::desired_type actual = learner.output(i->input);
+            // The same calling observe(sample, actual) for every sample
+            // with the output its learning starts from, so one pass gives
+            // both corrections and metrics (see run_metrics)
+            template <typename SamplePicker, typename Observer>
+            void learn_run(SamplePicker const &picker, Observer &observe) {
+                std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
 
-                    if (picker(*i, actual))
-                        learner.learn(i->input, learn_error(actual, i->desired));
+                ws.profile.clear();
+
+                if (batch != 1) {
+                    learn_batches(picker, observe);
+                } else {
+                    for (typename SampleSet::const_iterator i = _samples.begin();
+                            i != _samples.end(); ++i) {
+
+                        // May refer to the workspace, valid until learning
+                        const typename Sample::desired_type &actual =
+                            forward_output(learner, i->input, ws, 0);
+
+                        observe(*i, actual);
+
+                        if (picker(*i, actual))
+                            learn_forwarded(learner, i->input, learn_error(actual, i->desired), ws, 0);
+                        else
+                            KLOGIC_PROFILE_ADD(ws.profile.skipped_samples, 1);
+                    }
+                }
+
+                ++epochs;
+
+                if (on_epoch) {
+                    double seconds = std::chrono::duration<double>(
+                        std::chrono::steady_clock::now() - start).count();
+
+                    on_epoch(epoch_report(epochs, _samples.size(), seconds, ws.profile));
                 }
             }
 
+            // Called after every learn_run() (see epoch_report)
+            void set_epoch_callback(const epoch_callback &callback) { on_epoch = callback; }
+
+            // Counters of the last learn_run(), see profile.h
+            const learning_profile &profile() const { return ws.profile; }
+
             // Run against whole set
             void learn_run() {
                 learn_run<learn_always<Sample> >();
             }
 
-            // Calculate MSE for all samples
+            // Calculate MSE for all samples, see square_error()
             template <typename SquareError>
-            double mse(SquareError const &sq_err = SquareError()) {
-                double acc_error = 0.0;
+            double mse(SquareError const &sq_err = SquareError()) const {
+                return square_error(sq_err) / samples_count();
+            }
+
+            // Sum of sq_err over all samples. Samples are evaluated in
+            // parallel like in hits(), chunks of EVAL_CHUNK samples are
+            // summed separately and their sums are added in order. So the
+            // result doesn't depend on the number of threads
+            template <typename SquareError>
+            double square_error(SquareError const &sq_err = SquareError()) const {
+                typedef typename SampleSet::const_iterator iterator;
+
+                return evaluate<double>([&](iterator i, const typename Sample::desired_type &actual) {
+                    return sq_err(*i, actual);
+                });
+            }
+
+        private:
+            template <typename SamplePicker, typename Observer>
+            void learn_batches(SamplePicker const &picker, Observer &observe) {
+                typedef typename SampleSet::const_iterator iterator;
+
+                size_t size = (batch == FULL_BATCH) ? _samples.size() : batch;
+
+                for (iterator i = _samples.begin(); i != _samples.end(); ) {
+                    iterator batch_end = (size_t(_samples.end() - i) > size) ? i + size : _samples.end();
+
+                    learn_batch(learner, i, batch_end, picker, learn_error, ws, observe, 0);
+                    i = batch_end;
+                }
+            }
+
+            // Sum of f(sample iterator, actual output) over all samples,
+            // chunk by chunk. Each thread has its own learner workspace
+            template <typename Result, typename Function>
+            Result evaluate(Function f) const {
+                typedef typename SampleSet::const_iterator iterator;
+
+                long n = _samples.size();
+                long chunks = (n + EVAL_CHUNK - 1) / EVAL_CHUNK;
+                std::vector<Result> partial(chunks, Result());
+                const Learner &net = learner;
+
+#pragma omp parallel num_threads(thread_count()) if(chunks > 1)
+                {
+                    workspace_type thread_ws(net);
 
-                for (typename std::vector<Sample>::const_iterator i = _samples.begin();
-                        i != _samples.end(); ++i) {
+#pragma omp for schedule(dynamic)
+                    for (long c = 0; c < chunks; ++c) {
+                        iterator i = _samples.begin() + c * EVAL_CHUNK;
+                        iterator end = c + 1 < chunks ? i + EVAL_CHUNK : _samples.end();
+                        Result sum = Result();
 
-                    typename Sample::desired_type actual = learner.output(i->input);
+                        for (; i != end; ++i)
+                            sum += f(i, forward_output(net, i->input, thread_ws, 0));
 
-                    acc_error += sq_err(*i, actual);
+                        partial[c] = sum;
+                    }
                 }
 
-                return acc_error / samples_count();
+                Result total = Result();
+
+                for (long c = 0; c < chunks; ++c)
+                    total += partial[c];
+
+                return total;
             }
 
-        private:
-            std::vector<Sample> _samples;
+            // Samples owned by teacher. _samples views them if owned is true
+            std::vector<Sample> own_samples;
+            SampleSet _samples;
             Learner &learner;
+            workspace_type ws;
             LearnError learn_error;
+            bool owned;
+            size_t batch;
+            int threads;
+            size_t epochs;
+            epoch_callback on_epoch;
         };
 
         // ------------------
@@ -2,118 +2,503 @@
 #include <algorithm>
 #include <stdexcept>
 #include "mlmvn.h"
+#include "kernels.h"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 using std::vector;
 
-klogic::mlmvn::mlmvn(const vector<int> &sizes, const vector<int> &k_values)
-    : calculator(*this)
+namespace {
+    // Errors of a layer summed at once by backpropagation, they stay in
+    // L1 cache while rows of reciprocals go by
+    const int BACKPROP_BLOCK = 256;
+}
+
+klogic::mlmvn::mlmvn(const vector<int> &sizes, const vector<int> &k_values,
+                     const vector<int> &periods)
 {
     assert(sizes.size() == k_values.size() + 1);
 
+    if (!periods.empty() && periods.size() != k_values.size())
+        throw std::invalid_argument("klogic::mlmvn: one periods value per layer expected");
+
+    for (size_t layer = 0; layer < periods.size(); ++layer) {
+        int l = periods[layer];
+
+        if (l < 1 || (l > 1 && (k_values[layer] <= 0 || k_values[layer] > kernels::MAX_ROOTS_K / l)))
+            throw std::invalid_argument("klogic::mlmvn: bad periods of a layer");
+    }
+
+    set_topology(sizes);
+
+    for (size_t layer = 0; layer < layers_count(); ++layer) {
+        // current layer size
+        int size = sizes[layer + 1];
+
+        own_weights[layer].resize(size * (layer_inputs(layer) + 1));
+        weights[layer] = weights_view(own_weights[layer].data(), own_weights[layer].size());
+
+        bind_layer(layer, vector<int>(size, k_values[layer]),
+                   vector<int>(size, periods.empty() ? 1 : periods[layer]));
+
+        vector<mvn> &layer_neurons = neurons[layer];
+
+        for (int i = 0; i < size; ++i)
+            layer_neurons[i].randomize();
+    }
+}
+
+void klogic::mlmvn::set_topology(const vector<int> &sizes)
+{
     max_layer_size = -1;
     input_size  = sizes[0];
     output_size = sizes[sizes.size() - 1];
 
-    // Starting from 1 here because first element of sizes is inputs count
-    for (int layer = 1; layer < sizes.size(); ++layer) {
-        // k value for current layer
-        int k = k_values[layer - 1];
+    // First element of sizes is inputs count
+    size_t nlayers = sizes.size() - 1;
 
-        // inputs count for current layer
-        int ninputs = sizes[layer - 1];
+    weights.assign(nlayers, weights_view());
+    own_weights.assign(nlayers, aligned_cvector());
+    neurons.assign(nlayers, vector<mvn>());
+    mapped_model.reset();
 
-        // current layer size
-        int size = sizes[layer];
+    // Filled by the first update_reciprocals()
+    reciprocals.assign(nlayers, aligned_cvector());
+    reciprocals_stale.assign(nlayers, true);
 
-        if (size > max_layer_size)
-            max_layer_size = size;
+    for (size_t layer = 0; layer < nlayers; ++layer) {
+        if (sizes[layer + 1] > max_layer_size)
+            max_layer_size = sizes[layer + 1];
 
-        vector<mvn> layer_neurons(size);
+        // Unbound neurons, bind_layer() makes them point to weights
+        neurons[layer].resize(sizes[layer + 1]);
+    }
+}
 
-        for (int i = 0; i < size; ++i)
-            layer_neurons[i] = mvn(k, ninputs);
+klogic::mlmvn::mlmvn(const mlmvn &other)
+{
+    *this = other;
+}
+
+klogic::mlmvn &klogic::mlmvn::operator=(const mlmvn &other)
+{
+    if (this == &other)
+        return *this;
 
-        neurons.push_back(layer_neurons);
-        errors.push_back(cvector(size));
+    // Copy always gets its own weights, even if other one is mapped
+    own_weights.resize(other.weights.size());
+    weights.resize(other.weights.size());
+    mapped_model.reset();
+
+    for (size_t layer = 0; layer < weights.size(); ++layer) {
+        own_weights[layer].assign(other.weights[layer].begin(), other.weights[layer].end());
+        weights[layer] = weights_view(own_weights[layer].data(), own_weights[layer].size());
     }
+
+    max_layer_size = other.max_layer_size;
+    input_size     = other.input_size;
+    output_size    = other.output_size;
+
+    neurons.assign(other.neurons.size(), vector<mvn>());
+
+    for (size_t layer = 0; layer < neurons.size(); ++layer) {
+        const vector<mvn> &other_neurons = other.neurons[layer];
+        vector<int> k_values(other_neurons.size()), periods(other_neurons.size());
+
+        for (size_t i = 0; i < other_neurons.size(); ++i) {
+            k_values[i] = other_neurons[i].k_value();
+            periods[i]  = other_neurons[i].l_value();
+        }
+
+        bind_layer(layer, k_values, periods);
+    }
+
+    reciprocals       = other.reciprocals;
+    reciprocals_stale = other.reciprocals_stale;
+
+    return *this;
 }
 
-void klogic::mlmvn::learn(const klogic::cvector &X, const klogic::cvector &errs,
-                          double learning_rate)
+void klogic::mlmvn::bind_layer(size_t layer, const vector<int> &k_values,
+                               const vector<int> &periods)
 {
-    // Calculate errors for all neurons (backward pass)
-    calculate_errors(errs);
+    vector<mvn> &layer_neurons = neurons[layer];
+    int ninputs = layer_inputs(layer);
+    cmplx *row  = weights[layer].data();
 
-    // dump_errors();
+    // resize() and bind() in place: copying a vector of neurons would
+    // detach them from the packed storage
+    layer_neurons.clear();
+    layer_neurons.resize(k_values.size());
 
-    // Make a forward pass with error correction
-    calculator.start(X);
+    for (size_t i = 0; i < k_values.size(); ++i, row += ninputs + 1)
+        layer_neurons[i].bind(k_values[i], row, ninputs, periods[i]);
+}
+
+void klogic::mlmvn::learn(klogic::const_cspan X, const klogic::cvector &errs,
+                          double learning_rate, klogic::mlmvn_workspace &ws)
+{
+    // learn_forwarded() needs weighted sums of the first layer only,
+    // others are calculated on the fly. Errors of periodic neurons
+    // depend on their sums though
+    bool periodic = false;
+
+    for (size_t layer = 0; layer < layers_count(); ++layer)
+        periodic = periodic || layer_periods(layer) != 1;
 
-    do {
-        int layer = calculator.current_layer();
+    if (periodic)
+        forward(X, ws);
+    else
+        calculate_layer(0, X, ws);
 
+    learn_forwarded(X, errs, learning_rate, ws);
+}
+
+const klogic::cvector &klogic::mlmvn::forward(klogic::const_cspan X, klogic::mlmvn_workspace &ws) const
+{
+    assert(X.size() == input_size);
+
+    calculate_layer(0, X, ws);
+
+    for (size_t layer = 1; layer < layers_count(); ++layer)
+        calculate_layer(layer, ws.outputs[layer - 1], ws);
+
+    return ws.outputs.back();
+}
+
+void klogic::mlmvn::calculate_layer(size_t layer, klogic::const_cspan input,
+                                    klogic::mlmvn_workspace &ws) const
+{
+    const vector<mvn> &layer_neurons = neurons[layer];
+    cvector &sums    = ws.sums[layer];
+    cvector &outputs = ws.outputs[layer];
+
+    KLOGIC_PROFILE_TIME(ws.profile.layers[layer].forward_seconds);
+    KLOGIC_PROFILE_ADD(ws.profile.layers[layer].weighted_sums, layer_neurons.size());
+
+    for (size_t i = 0; i < layer_neurons.size(); ++i)
+        sums[i] = layer_neurons[i].weighted_sum(input);
+
+    int k = layer_k(layer), l = layer_periods(layer);
+
+    if (k > 0 && l > 0) {
+        // Discrete layer is activated at once. Continuous activation stays
+        // per neuron: kernels::normalize() may round differently
+        copy(sums.begin(), sums.end(), outputs.begin());
+
+        if (l == 1)
+            kernels::activate(k, outputs.data(), outputs.size());
+        else
+            kernels::activate_periodic(k, l, outputs.data(), outputs.size());
+    } else {
+        for (size_t i = 0; i < layer_neurons.size(); ++i)
+            outputs[i] = layer_neurons[i].activation(sums[i]);
+    }
+}
+
+int klogic::mlmvn::layer_k(size_t layer) const
+{
+    const vector<mvn> &layer_neurons = neurons[layer];
+    int k = layer_neurons[0].k_value();
+
+    for (size_t i = 1; i < layer_neurons.size(); ++i) {
+        if (layer_neurons[i].k_value() != k)
+            return -1;
+    }
+
+    return k;
+}
+
+int klogic::mlmvn::layer_periods(size_t layer) const
+{
+    const vector<mvn> &layer_neurons = neurons[layer];
+    int l = layer_neurons[0].l_value();
+
+    for (size_t i = 1; i < layer_neurons.size(); ++i) {
+        if (layer_neurons[i].l_value() != l)
+            return -1;
+    }
+
+    return l;
+}
+
+void klogic::mlmvn::periodic_errors(size_t layer, klogic::mlmvn_workspace &ws) const
+{
+    if (layer_periods(layer) == 1)
+        return;
+
+    const vector<mvn> &layer_neurons = neurons[layer];
+    cvector &layer_errors = ws.errors[layer];
+
+    for (size_t i = 0; i < layer_neurons.size(); ++i)
+        layer_errors[i] = layer_neurons[i].periodic_error(ws.sums[layer][i], layer_errors[i]);
+}
+
+void klogic::mlmvn::learn_forwarded(klogic::const_cspan X, const klogic::cvector &errs,
+                                    double learning_rate, klogic::mlmvn_workspace &ws)
+{
+    update_reciprocals();
+    learn_forwarded_fresh(X, errs, learning_rate, ws);
+}
+
+void klogic::mlmvn::learn_forwarded_fresh(klogic::const_cspan X, const klogic::cvector &errs,
+                                          double learning_rate, klogic::mlmvn_workspace &ws)
+{
+    assert(X.size() == input_size);
+
+    for (size_t layer = 1; layer < layers_count(); ++layer)
+        assert(!reciprocals_stale[layer]);
+
+    KLOGIC_PROFILE_ADD(ws.profile.learn_calls, 1);
+
+    // Calculate errors for all neurons (backward pass)
+    calculate_errors(errs, ws);
+
+    // dump_errors(ws);
+
+    // Make a forward pass with error correction. Each layer gets outputs
+    // of the previous one calculated with already corrected weights, as
+    // learn() always did.
+    //
+    // Weighted sums of the first layer are known from forward(). For other
+    // layers the input has changed, so they are calculated once here (they
+    // are needed for |z| anyway). Corrected neuron outputs don't need
+    // another weighted sum: correction by `factor` changes it by
+    // factor*(1 + |x_1|^2 + ... + |x_N|^2). Output of the last layer isn't
+    // needed at all.
+    size_t last = layers_count() - 1;
+
+    for (size_t layer = 0; layer <= last; ++layer) {
         // Divide by |z| for all layers except output
-        bool variable_rate = layer < layers_count() - 1;
+        bool variable_rate = layer < last;
 
         vector<mvn>   &layer_neurons = neurons[layer];
-        cvector const &layer_errors  = errors[layer];
+        cvector const &layer_errors  = ws.errors[layer];
+        cvector       &sums          = ws.sums[layer];
+        cvector       &outputs       = ws.outputs[layer];
 
         // Input for current layer
-        cvector::const_iterator input_begin = calculator.input_begin(),
-                                input_end   = calculator.input_end();
+        const_cspan input = (layer == 0) ? X : const_cspan(ws.outputs[layer - 1]);
+
+        scalar input_norm = 1;      // 1 is for bias
+
+        if (variable_rate) {
+            for (const cmplx *x = input.begin(); x != input.end(); ++x)
+                input_norm += std::norm(*x);
+        }
 
-        // Learn current layer of neurons
-//#pragma omp parallel
+        // Learn current layer of neurons. Neurons are independent, so
+        // big layers are split between threads
+        int nthreads = parallel_opts.thread_count();
+        int layer_size = layer_neurons.size();
+
+        KLOGIC_PROFILE_TIME(ws.profile.layers[layer].update_seconds);
+        KLOGIC_PROFILE_ADD(ws.profile.layers[layer].corrections, layer_size);
+        KLOGIC_PROFILE_ADD(ws.profile.layers[layer].weighted_sums,
+                           variable_rate && layer > 0 ? layer_size : 0);
+        KLOGIC_PROFILE_ADD(ws.profile.layers[layer].divisions,
+                           layer > 0 ? layer_size * input.size() : 0);
+
+#pragma omp parallel num_threads(nthreads) if(parallel_layer(layer))
         {
-//#pragma omp for
-            for (int k = 0; k < layer_neurons.size(); ++k) {
-                layer_neurons[k].learn(input_begin, input_end, layer_errors[k],
-                                       learning_rate, variable_rate);
+#pragma omp for schedule(static)
+            for (int k = 0; k < layer_size; ++k) {
+                mvn &neuron = layer_neurons[k];
+
+                if (variable_rate && layer > 0)
+                    sums[k] = neuron.weighted_sum(input);
+
+                cmplx factor = neuron.learning_factor(layer_errors[k], learning_rate,
+                                                      variable_rate, sums[k]);
+
+                neuron.correct(input, factor);
+
+                // Keep reciprocals of corrected weights for the next
+                // backward pass
+                if (layer > 0) {
+                    size_t ninputs = input.size();
+
+                    kernels::reciprocals(weights[layer].data() + k * (ninputs + 1) + 1,
+                                         reciprocals[layer].data() + k * ninputs, ninputs);
+                }
+
+                if (variable_rate) {
+                    sums[k]   += factor * input_norm;
+                    outputs[k] = neuron.activation(sums[k]);
+                }
             }
         }
-    } while (!calculator.step());
+    }
 
     // dump();
 }
 
-void klogic::mlmvn::calculate_errors(const klogic::cvector &errs)
+void klogic::mlmvn::accumulate(klogic::const_cspan X, const klogic::cvector &errs,
+                               double learning_rate, klogic::mlmvn_workspace &ws,
+                               klogic::mlmvn_gradient &g) const
+{
+    assert(X.size() == input_size);
+
+    KLOGIC_PROFILE_ADD(ws.profile.learn_calls, 1);
+
+    calculate_errors(errs, ws);
+
+    size_t last = layers_count() - 1;
+
+    for (size_t layer = 0; layer <= last; ++layer) {
+        // Divide by |z| for all layers except output
+        bool variable_rate = layer < last;
+
+        const vector<mvn> &layer_neurons = neurons[layer];
+        const cvector     &layer_errors  = ws.errors[layer];
+        const cvector     &sums          = ws.sums[layer];
+
+        const_cspan input = (layer == 0) ? X : const_cspan(ws.outputs[layer - 1]);
+        size_t stride = input.size() + 1;
+        cmplx *row = &g.layers[layer][0];
+
+        KLOGIC_PROFILE_TIME(ws.profile.layers[layer].update_seconds);
+
+        for (size_t k = 0; k < layer_neurons.size(); ++k, row += stride) {
+            cmplx factor = layer_neurons[k].learning_factor(layer_errors[k], learning_rate,
+                                                            variable_rate, sums[k]);
+
+            row[0] += factor;
+
+            kernels::add_conj_scaled(row + 1, factor, input.begin(), input.size());
+        }
+    }
+}
+
+void klogic::mlmvn::apply(const klogic::mlmvn_gradient &g, double scale)
+{
+    assert(g.layers.size() == weights.size());
+
+    for (size_t layer = 0; layer < weights.size(); ++layer) {
+        weights_view           w  = weights[layer];
+        const aligned_cvector &dw = g.layers[layer];
+
+        assert(w.size() == dw.size());
+
+        for (size_t i = 0; i < w.size(); ++i)
+            w[i] += scalar(scale) * dw[i];
+
+        reciprocals_stale[layer] = true;
+    }
+
+    update_reciprocals();
+}
+
+void klogic::mlmvn::update_reciprocals()
+{
+    for (size_t layer = 1; layer < layers_count(); ++layer) {
+        if (!reciprocals_stale[layer])
+            continue;
+
+        size_t ninputs = layer_inputs(layer);
+        aligned_cvector &r = reciprocals[layer];
+        const cmplx *row = weights[layer].data();
+
+        r.resize(layer_size(layer) * ninputs);
+
+        for (size_t i = 0; i < layer_size(layer); ++i, row += ninputs + 1)
+            kernels::reciprocals(row + 1, &r[i * ninputs], ninputs);
+
+        reciprocals_stale[layer] = false;
+    }
+}
+
+void klogic::mlmvn::calculate_errors(const klogic::cvector &errs, klogic::mlmvn_workspace &ws) const
 {
     assert(errs.size() == output_size);
 
     int j = neurons.size() - 1;
 
-    cvector::iterator q = errors[j].begin();
-    double s_m = s_j(j);
+    cvector::iterator q = ws.errors[j].begin();
+    scalar s_m = s_j(j);
+
+    KLOGIC_PROFILE_ADD(ws.profile.layers[j].divisions, errs.size());
 
     // Use (4.121) to calculate errors for output layer
     for (cvector::const_iterator i = errs.begin(); i != errs.end(); ++i, ++q) {
-        *q = *i / s_m;
+        *q = *i;
     }
 
+    // Output error of a periodic neuron becomes error of its weighted sum
+    // before the division, as a single MVN-P learns
+    periodic_errors(j, ws);
+
+    for (q = ws.errors[j].begin(); q != ws.errors[j].end(); ++q)
+        *q /= s_m;
+
     // Now use (4.122)
     // \delta_{k,j} = (1/s_{j})
     //                \sum_{i=1}^{N_{j+1}} \delta_{i,j+1} (w_k^{i,j+1})^{-1}
     for (--j; j >= 0; --j) {
-        cvector             &layer_errors       = errors[j];
-        const cvector       &next_layer_errors  = errors[j+1];
+        cvector             &layer_errors       = ws.errors[j];
+        const cvector       &next_layer_errors  = ws.errors[j+1];
         const vector<mvn>   &next_layer_neurons = neurons[j+1];
 
         int next_layer_size = next_layer_errors.size();
-        double layer_s_j = s_j(j);
-
-        // NOTE can be parallelized
-#pragma omp parallel
-        {
-#pragma omp for
-            for (int k = 0; k < layer_errors.size(); ++k) {
-                cmplx sum(0);
+        int layer_size = layer_errors.size();
+        scalar layer_s_j = s_j(j);
+
+        // Work is proportional to the next layer weights count
+        int nthreads = parallel_opts.thread_count();
+
+        KLOGIC_PROFILE_TIME(ws.profile.layers[j].backward_seconds);
+        KLOGIC_PROFILE_ADD(ws.profile.layers[j].divisions,
+                           reciprocals_stale[j+1] ? (next_layer_size + 1) * layer_size : layer_size);
+
+        if (reciprocals_stale[j+1]) {
+#pragma omp parallel num_threads(nthreads) if(parallel_layer(j+1))
+            {
+#pragma omp for schedule(static)
+                for (int k = 0; k < layer_size; ++k) {
+                    cmplx sum(0);
+
+                    // Zero (pruned) weights are skipped as with
+                    // kernels::reciprocals()
+                    for (int i = 0; i < next_layer_size; ++i) {
+                        cmplx w = next_layer_neurons[i].weight_for_input(k);
+
+                        if (w != cmplx(0))
+                            sum += next_layer_errors[i] / w;
+                    }
+
+                    layer_errors[k] = sum;
+                }
+            }
+        } else {
+            // The same sums as delta^T R: rows of reciprocals R are added
+            // to errors of a block scaled by next layer errors. Terms are
+            // added in the same order as above, but with multiplication
+            // by 1/w
+            const cmplx *R = reciprocals[j+1].data();
+            int blocks = (layer_size + BACKPROP_BLOCK - 1) / BACKPROP_BLOCK;
+
+#pragma omp parallel for num_threads(nthreads) schedule(static) if(parallel_layer(j+1))
+            for (int b = 0; b < blocks; ++b) {
+                int first = b * BACKPROP_BLOCK;
+                int count = std::min(BACKPROP_BLOCK, layer_size - first);
+                cmplx *block = &layer_errors[first];
+
+                std::fill(block, block + count, cmplx(0));
 
                 for (int i = 0; i < next_layer_size; ++i)
-                    sum += next_layer_errors[i] / next_layer_neurons[i].weight_for_input(k);
-
-                layer_errors[k] = sum / layer_s_j;
+                    kernels::add_scaled(block, next_layer_errors[i], R + i * layer_size + first, count);
             }
         }
+
+        // Backpropagated sums are output errors, as on the output layer
+        // periodic neurons turn them into errors of weighted sums before
+        // the division
+        periodic_errors(j, ws);
+
+        for (int k = 0; k < layer_size; ++k)
+            layer_errors[k] /= layer_s_j;
     }
 }
 
@@ -128,10 +513,10 @@ void klogic::mlmvn::dump() const
     }
 }
 
-void klogic::mlmvn::dump_errors() const
+void klogic::mlmvn::dump_errors(const klogic::mlmvn_workspace &ws) const
 {
     for (int layer = 0; layer < layers_count(); ++layer) {
-        const cvector &layer_errs = errors[layer];
+        const cvector &layer_errs = ws.errors[layer];
 
         for (int k = 0; k < layer_errs.size(); ++k) {
             std::cerr << "Delta[" << (k+1) << ',' << (layer+1) << "] = " << layer_errs[k] << std::endl;
@@ -156,9 +541,23 @@ void klogic::mlmvn::get_stats(size_t &n_weights, size_t &n_neurons) const
 }
 
 void klogic::mlmvn::export_neurons(klogic::cvector &all_weights, std::vector<int> &k_values) const
+{
+    vector<int> periods;
+
+    export_neurons(all_weights, k_values, periods);
+
+    for (size_t i = 0; i < periods.size(); ++i) {
+        if (periods[i] != 1)
+            throw std::invalid_argument("klogic::mlmvn::export_neurons(): periodic neurons need periods");
+    }
+}
+
+void klogic::mlmvn::export_neurons(klogic::cvector &all_weights, std::vector<int> &k_values,
+                                   std::vector<int> &periods) const
 {
     all_weights.clear();
     k_values.clear();
+    periods.clear();
 
     // calculate number of weights and reserve this size
     size_t n_weights, n_neurons;
@@ -167,16 +566,18 @@ void klogic::mlmvn::export_neurons(klogic::cvector &all_weights, std::vector<int
 
     all_weights.reserve(n_weights);
     k_values.reserve(n_neurons);
+    periods.reserve(n_neurons);
 
     for (int layer = 0; layer < layers_count(); ++layer) {
         const vector<mvn> &layer_neurons = neurons[layer];
 
         for (int k = 0; k < layer_neurons.size(); ++k) {
             // Neuron [(k+1), (layer+1)]
-            const cvector &weights(layer_neurons[k].weights_vector());
+            const_weights_view neuron_weights(layer_neurons[k].weights_vector());
 
-            all_weights.insert(all_weights.end(), weights.begin(), weights.end());
+            all_weights.insert(all_weights.end(), neuron_weights.begin(), neuron_weights.end());
             k_values.push_back(layer_neurons[k].k_value());
+            periods.push_back(layer_neurons[k].l_value());
         }
     }
 
@@ -186,32 +587,50 @@ void klogic::mlmvn::export_neurons(klogic::cvector &all_weights, std::vector<int
 }
 
 void klogic::mlmvn::load_neurons(const klogic::cvector &all_weights, const std::vector<int> &k_values)
+{
+    load_neurons(all_weights, k_values, vector<int>(k_values.size(), 1));
+}
+
+void klogic::mlmvn::load_neurons(const klogic::cvector &all_weights, const std::vector<int> &k_values,
+                                 const std::vector<int> &periods)
 {
     size_t n_weights, n_neurons;
 
     get_stats(n_weights, n_neurons);
 
-    if (all_weights.size() != n_weights || k_values.size() != n_neurons)
+    if (all_weights.size() != n_weights || k_values.size() != n_neurons || periods.size() != n_neurons)
         throw std::runtime_error("klogic::mlmvn::load_neurons(): size mismatch");
 
+    // The same checks as mvn(k, N, l), before anything is changed
+    for (size_t i = 0; i < n_neurons; ++i) {
+        int k = k_values[i], l = periods[i];
+
+        if (k < 0 || l < 1 || (l > 1 && (k == 0 || k > kernels::MAX_ROOTS_K / l)))
+            throw std::invalid_argument("klogic::mlmvn::load_neurons(): bad k or periods of a neuron");
+    }
+
     klogic::cvector::const_iterator  it_w = all_weights.begin();
-    std::vector<int>::const_iterator it_k = k_values.begin();
+    std::vector<int>::const_iterator it_k = k_values.begin(), it_l = periods.begin();
 
     for (int layer = 0; layer < layers_count(); ++layer) {
         vector<mvn> &layer_neurons = neurons[layer];
 
         for (int k = 0; k < layer_neurons.size(); ++k) {
             // Neuron [(k+1), (layer+1)]
-            size_t w = layer_neurons[k].weights_vector().size();
-            mvn neuron(*it_k, w - 1);
+            mvn &neuron = layer_neurons[k];
+            size_t w = neuron.weights_vector().size();
 
-            copy(it_w, it_w + w, neuron.weights_vector().begin());
+            neuron.k = *it_k;
+            neuron.l = *it_l;
 
-            layer_neurons[k] = neuron;
+            copy(it_w, it_w + w, neuron.weights_vector().begin());
 
             it_w += w;
             ++it_k;
+            ++it_l;
         }
+
+        reciprocals_stale[layer] = true;
     }
 
     assert(it_w == all_weights.end());
@@ -219,22 +638,75 @@ void klogic::mlmvn::load_neurons(const klogic::cvector &all_weights, const std::
 }
 
 /*
- * mlmvn_forward_base
+ * mlmvn_workspace
  */
 
-klogic::mlmvn_forward_base::mlmvn_forward_base(const klogic::mlmvn &_net)
-    : net(_net)
+klogic::mlmvn_workspace::mlmvn_workspace(const klogic::mlmvn &net)
+    : profile(net.layers_count())
 {
+    for (size_t layer = 0; layer < net.layers_count(); ++layer) {
+        sums.push_back(cvector(net.layer_size(layer)));
+        outputs.push_back(cvector(net.layer_size(layer)));
+        errors.push_back(cvector(net.layer_size(layer)));
+    }
 }
 
-void klogic::mlmvn_forward_base::start(const klogic::cvector &X, cvector::iterator _out)
+/*
+ * mlmvn_gradient
+ */
+
+klogic::mlmvn_gradient::mlmvn_gradient(const klogic::mlmvn &net)
 {
-    layer1.resize(net.max_layer_size);
+    for (size_t layer = 0; layer < net.layers_count(); ++layer)
+        layers.push_back(aligned_cvector(net.layer_size(layer) * (net.layer_inputs(layer) + 1)));
+}
 
-    // Allocate memory for 1 or 2 layers
+void klogic::mlmvn_gradient::clear()
+{
+    for (size_t layer = 0; layer < layers.size(); ++layer)
+        std::fill(layers[layer].begin(), layers[layer].end(), cmplx(0));
+}
+
+void klogic::mlmvn_gradient::add(const klogic::mlmvn_gradient &other)
+{
+    assert(other.layers.size() == layers.size());
+
+    for (size_t layer = 0; layer < layers.size(); ++layer) {
+        aligned_cvector       &to   = layers[layer];
+        const aligned_cvector &from = other.layers[layer];
+
+        for (size_t i = 0; i < to.size(); ++i)
+            to[i] += from[i];
+    }
+}
+
+/*
+ * parallel_options
+ */
+
+int klogic::parallel_options::thread_count() const
+{
+#ifdef _OPENMP
+    return threads > 0 ? threads : omp_get_max_threads();
+#else
+    return 1;
+#endif
+}
+
+/*
+ * mlmvn_forward_base
+ */
+
+klogic::mlmvn_forward_base::mlmvn_forward_base(const klogic::mlmvn &_net)
+    : net(_net), layer1(_net.max_layer_size)
+{
+    // Allocate memory for 1 or 2 layers once, start() doesn't allocate
     if (net.layers_count() > 1)
         layer2.resize(layer1.size());
+}
 
+void klogic::mlmvn_forward_base::start(const klogic::cvector &X, cvector::iterator _out)
+{
     from = &X;
     to = &layer1;
     from_size = X.size();
@@ -286,3 +758,104 @@ bool klogic::mlmvn_forward_base::step()
 
     return ++layer >= net.layers_count();
 }
+
+/*
+ * mlmvn_batch_forward
+ */
+
+klogic::mlmvn_batch_forward::mlmvn_batch_forward(const klogic::mlmvn &_net, size_t max_batch)
+    : net(_net), batch(max_batch)
+{
+    assert(batch > 0);
+
+    layer1.resize(batch * net.max_layer_size);
+
+    // Allocate memory for 1 or 2 layers
+    if (net.layers_count() > 1)
+        layer2.resize(layer1.size());
+}
+
+void klogic::mlmvn_batch_forward::output(const klogic::cmplx *X, size_t count, klogic::cmplx *out)
+{
+    for (size_t done = 0; done < count; done += batch) {
+        size_t block = std::min(batch, count - done);
+
+        output_block(X + done * net.input_size, block, out + done * net.output_size);
+    }
+}
+
+void klogic::mlmvn_batch_forward::output(const vector<klogic::cvector> &X, vector<klogic::cvector> &out)
+{
+    size_t in_size = net.input_size, out_size = net.output_size;
+
+    packed_in.resize(batch * in_size);
+    packed_out.resize(batch * out_size);
+    out.resize(X.size());
+
+    for (size_t done = 0; done < X.size(); done += batch) {
+        size_t block = std::min(batch, X.size() - done);
+
+        for (size_t b = 0; b < block; ++b) {
+            assert(X[done + b].size() == in_size);
+            std::copy(X[done + b].begin(), X[done + b].end(), packed_in.begin() + b * in_size);
+        }
+
+        output_block(&packed_in[0], block, &packed_out[0]);
+
+        for (size_t b = 0; b < block; ++b) {
+            aligned_cvector::const_iterator res = packed_out.begin() + b * out_size;
+
+            out[done + b].assign(res, res + out_size);
+        }
+    }
+}
+
+void klogic::mlmvn_batch_forward::weighted_sums(const klogic::cmplx *X, size_t count, klogic::cmplx *out)
+{
+    for (size_t done = 0; done < count; done += batch) {
+        size_t block = std::min(batch, count - done);
+
+        output_block(X + done * net.input_size, block, out + done * net.output_size, false);
+    }
+}
+
+void klogic::mlmvn_batch_forward::output_block(const klogic::cmplx *X, size_t count, klogic::cmplx *out,
+                                               bool activate_output)
+{
+    assert(count <= batch);
+
+    const cmplx *from = X;
+    cmplx *to = layer1.data();
+
+    for (size_t layer = 0; layer < net.layers_count(); ++layer) {
+        const vector<mvn> &layer_neurons = net.neurons[layer];
+        size_t rows = layer_neurons.size();
+
+        // Output layer writes straight to out
+        if (layer == net.layers_count() - 1)
+            to = out;
+
+        kernels::layer_sums(net.layer_weights(layer), rows, net.layer_inputs(layer),
+                            from, count, to);
+
+        if (layer == net.layers_count() - 1 && !activate_output)
+            break;
+
+        // Activate the whole block at once if all neurons share k and l
+        int k = net.layer_k(layer), l = net.layer_periods(layer);
+
+        if (k >= 0 && l == 1)
+            kernels::activate(k, to, rows * count);
+        else if (k > 0 && l > 1)
+            kernels::activate_periodic(k, l, to, rows * count);
+        else {
+            for (size_t b = 0; b < count; ++b)
+                for (size_t i = 0; i < rows; ++i)
+                    to[b * rows + i] = layer_neurons[i].activation(to[b * rows + i]);
+        }
+
+        // Output of this layer is input for the next one
+        from = to;
+        to   = (to == layer1.data()) ? layer2.data() : layer1.data();
+    }
+}
@@ -1,14 +1,44 @@
 // MLMVN implementation
 #pragma once
 
+#include <memory>
+#include <string>
 #include "mvn.h"
+#include "profile.h"
 
 namespace klogic {
     class mlmvn;
+    class model_file;
+
+    // How mlmvn(path, storage) gets weights from a model file
+    enum model_storage {
+        MODEL_COPY,     // read into network's own buffers
+        MODEL_MAP       // use mapped file in place, copy-on-write
+    };
+
+    // Parallel training settings. Work is done by OpenMP threads, so they
+    // matter only if the library is built with OpenMP
+    struct parallel_options {
+        // Number of threads, 0 means OpenMP default (OMP_NUM_THREADS or
+        // number of cores)
+        int threads;
+
+        // Neuron loops of a layer (weights correction and error
+        // backpropagation) run in parallel only if the layer has at least
+        // this many weights. Smaller layers don't pay for a thread team
+        size_t min_layer_weights;
+
+        parallel_options() : threads(0), min_layer_weights(1 << 15) {}
+
+        // Actual number of threads to use
+        int thread_count() const;
+    };
 
     // Separate class for calculating mlmvn output allows to parallelize, but
     // is stingy about memory allocation. It uses max. two vectors to support
-    // computations for networks containing arbitrary number of layers
+    // computations for networks containing arbitrary number of layers.
+    // They are allocated by constructor, so repeated calculations with the
+    // same object don't allocate
     class mlmvn_forward_base {
     public:
         mlmvn_forward_base(const mlmvn &_net);
@@ -68,17 +98,73 @@ namespace klogic {
 
     //--------------------------------------------------------------
 
+    // Scratch data of one training step: weighted sums, outputs and errors
+    // of every layer. mlmvn::forward() fills sums and outputs and
+    // mlmvn::learn_forwarded() reuses them instead of running the network
+    // again. The network itself keeps no scratch data, so every trainer or
+    // evaluator of a shared network has its own workspace
+    class mlmvn_workspace {
+    public:
+        mlmvn_workspace() {}
+        mlmvn_workspace(const mlmvn &net);
+
+        // Per-layer values, indexed as mlmvn layers
+        std::vector<cvector> sums, outputs, errors;
+
+        // Counters of calls made with this workspace, see profile.h
+        learning_profile profile;
+    };
+
+    //--------------------------------------------------------------
+
+    // Weight corrections accumulated over several samples. Shaped as
+    // mlmvn::layer_weights(): one packed matrix per layer
+    class mlmvn_gradient {
+    public:
+        mlmvn_gradient() {}
+        mlmvn_gradient(const mlmvn &net);
+
+        // Set all corrections to zero
+        void clear();
+
+        // Add other gradient to this one
+        void add(const mlmvn_gradient &other);
+
+        std::vector<aligned_cvector> layers;
+    };
+
+    //--------------------------------------------------------------
+
     class mlmvn {
         friend class mlmvn_forward;
         friend class mlmvn_forward_base;
+        friend class mlmvn_batch_forward;
+        friend class mlmvn_hogwild_learner;
     public:
         typedef cvector desired_type;
+        typedef mlmvn_gradient gradient_type;
+        typedef mlmvn_workspace workspace_type;
 
         // Construct an MLMVN. sizes is the following:
         // Number of inputs, hidden layer 1 size, ...,
-        // hidden layer M size, output layer size
+        // hidden layer M size, output layer size.
+        // periods, if given, makes layers with l > 1 periodic (MVN-P, see
+        // mvn.h); such layers must be discrete. Throws
+        // std::invalid_argument for bad periods
         mlmvn(const std::vector<int> &sizes,
-              const std::vector<int> &k_values);
+              const std::vector<int> &k_values,
+              const std::vector<int> &periods = std::vector<int>());
+
+        // Load network saved by save(). With MODEL_MAP weights stay in
+        // the mapped file: nothing is read until used and learning changes
+        // private copies of touched pages only. Throws std::runtime_error
+        explicit mlmvn(const std::string &path, model_storage storage = MODEL_COPY);
+
+        // Save topology, k values and weights (see model.h)
+        void save(const std::string &path) const;
+
+        mlmvn(const mlmvn &other);
+        mlmvn &operator=(const mlmvn &other);
 
         // Total layer count in network (hidden + one output)
         size_t layers_count() const { return neurons.size(); }
@@ -92,12 +178,73 @@ namespace klogic {
         // Output (last) layer size
         size_t output_layer_size() const { return output_size; }
 
-        // Correct weights
-        void learn(const cvector &X, const cvector &error,
-            double learning_rate = 1.0);
+        // Inputs count of specific layer
+        size_t layer_inputs(size_t layer) const {
+            return layer == 0 ? input_size : neurons[layer - 1].size();
+        }
+
+        // Packed weights of specific layer. This is a row-major matrix with
+        // layer_size(layer) rows and layer_inputs(layer)+1 columns, bias
+        // goes first in each row
+        const cmplx *layer_weights(size_t layer) const { return weights[layer].data(); }
+
+        cmplx *layer_weights(size_t layer) {
+            reciprocals_stale[layer] = true;
+            return weights[layer].data();
+        }
+
+        // Error backpropagation (4.122) divides by weights of the next
+        // layer. Reciprocals of weights of all layers but the first are
+        // cached, so it becomes a transposed matrix-vector product. Cache
+        // rows are refreshed by learning as weights are corrected. Getting
+        // weights through non-const neuron() or layer_weights() marks the
+        // cache of their layer stale; learn() and apply() call this
+        // themselves, concurrent learners (see parallel.h) call it before
+        // starting threads. Stale layers fall back to division. Not thread
+        // safe: it resizes the cache
+        void update_reciprocals();
+
+        // Correct weights. Inputs may be given as cvector or any other
+        // contiguous storage (see const_cspan). ws keeps intermediate
+        // results, the version without it allocates a workspace each call
+        void learn(const_cspan X, const cvector &error,
+                   double learning_rate, mlmvn_workspace &ws);
+
+        void learn(const_cspan X, const cvector &error,
+                   double learning_rate = 1.0) {
+            mlmvn_workspace ws(*this);
+
+            learn(X, error, learning_rate, ws);
+        }
+
+        // Forward pass saving weighted sums and outputs of all layers to ws.
+        // Returns network output (it's stored in ws)
+        const cvector &forward(const_cspan X, mlmvn_workspace &ws) const;
 
-        // i-th neuron in j-th layer
+        // Correct weights after forward(X, ws) made with current weights.
+        // Error backpropagation and correction use saved sums and outputs,
+        // so the forward pass is not repeated
+        void learn_forwarded(const_cspan X, const cvector &error,
+                             double learning_rate, mlmvn_workspace &ws);
+
+        // Add corrections learn_forwarded() would make to g instead of
+        // changing weights. Unlike learn_forwarded() every layer uses
+        // inputs from the forward pass, i.e. this is batch learning rule
+        void accumulate(const_cspan X, const cvector &error,
+                        double learning_rate, mlmvn_workspace &ws,
+                        mlmvn_gradient &g) const;
+
+        // Add scale*g to weights
+        void apply(const mlmvn_gradient &g, double scale = 1.0);
+
+        // Parallel training settings
+        const parallel_options &parallel() const { return parallel_opts; }
+        void set_parallel(const parallel_options &options) { parallel_opts = options; }
+
+        // i-th neuron in j-th layer. Its weights are a view into
+        // layer_weights(j)
         mvn &neuron(int i, int j) {
+            reciprocals_stale[j] = true;
             return neurons[j][i];
         }
 
@@ -105,34 +252,94 @@ namespace klogic {
             return neurons[j][i];
         }
 
-        // Net output. Use with care since it allocates memory on each run
+        // Net output. Use with care since it allocates memory on each run,
+        // see mlmvn_workspace_pool for allocation-free concurrent calls
         cvector output(const cvector &X) const;
+        cvector output(const_cspan X) const;
 
         void dump() const;
-        void dump_errors() const;
+        // Errors of the last learning step made with ws
+        void dump_errors(const mlmvn_workspace &ws) const;
 
+        // Weights and k values of all neurons one after another. Periodic
+        // neurons need the version with periods, this one throws
+        // std::invalid_argument for them
         void export_neurons(cvector &all_weights, std::vector<int> &k_values) const;
+        void export_neurons(cvector &all_weights, std::vector<int> &k_values,
+                            std::vector<int> &periods) const;
+
+        // Set what export_neurons() gives, periods are 1 if not given.
+        // Throws std::runtime_error if sizes don't match and
+        // std::invalid_argument for k and l that mvn(k, N, l) rejects; the
+        // network is not changed then
         void load_neurons(const cvector &all_weights, const std::vector<int> &k_values);
+        void load_neurons(const cvector &all_weights, const std::vector<int> &k_values,
+                          const std::vector<int> &periods);
 
     protected:
         // Calculate errors for all neurons given
         // output layer errors
-        void calculate_errors(const cvector &errs);
+        void calculate_errors(const cvector &errs, mlmvn_workspace &ws) const;
+
+        // learn_forwarded() once the cache of reciprocals is up to date.
+        // Only rows of corrected neurons are rewritten, the cache is never
+        // resized or flagged, so concurrent learners may call it from
+        // several threads
+        void learn_forwarded_fresh(const_cspan X, const cvector &error,
+                                   double learning_rate, mlmvn_workspace &ws);
+
+        // True if neuron loops of a layer should run in parallel
+        bool parallel_layer(size_t layer) const {
+            return weights[layer].size() >= parallel_opts.min_layer_weights;
+        }
+
+        // Calculate weighted sums and outputs of a layer for given input
+        void calculate_layer(size_t layer, const_cspan input,
+                             mlmvn_workspace &ws) const;
+
+        // k shared by all neurons of a layer, -1 if they differ
+        int layer_k(size_t layer) const;
+
+        // l shared by all neurons of a layer, -1 if they differ
+        int layer_periods(size_t layer) const;
+
+        // Turn errors of periodic neurons of a layer into errors of their
+        // weighted sums (see mvn::periodic_error())
+        void periodic_errors(size_t layer, mlmvn_workspace &ws) const;
 
         // Get overall weights and neurons counts
         void get_stats(size_t &n_weights, size_t &n_neurons) const;
 
+        // Set layer sizes, neurons are not bound yet
+        void set_topology(const std::vector<int> &sizes);
+
+        // Bind neurons of a layer to its packed weights
+        void bind_layer(size_t layer, const std::vector<int> &k_values,
+                        const std::vector<int> &periods);
+
+        // Packed weights, one view per layer (see layer_weights()). They
+        // point to own_weights or to mapped model file
+        std::vector<weights_view>        weights;
+        std::vector<aligned_cvector>     own_weights;
+        std::shared_ptr<model_file>      mapped_model;
+
+        // Neurons of each layer keep views into weights
         std::vector<std::vector<mvn> >   neurons;
-        std::vector<std::vector<cmplx> > errors;
 
-        int s_j(int j) {
+        // Reciprocals of weights without bias, layer_size() rows of
+        // layer_inputs() values (see update_reciprocals()). Layer 0 has
+        // none since errors are not propagated to inputs
+        std::vector<aligned_cvector>     reciprocals;
+        std::vector<bool>                reciprocals_stale;
+
+        int s_j(int j) const {
             return (j <= 0) ? 1 : 1 + neurons[j-1].size();
         }
 
         int max_layer_size;
         size_t input_size, output_size;
 
-        mlmvn_forward_base calculator;
+        parallel_options parallel_opts;
     };
 
     //--------------------------------------------------------------
@@ -163,7 +370,55 @@ namespace klogic {
 
     //--------------------------------------------------------------
 
+    // Forward pass for blocks of samples. Every layer is calculated as a
+    // complex matrix-matrix product (see kernels::layer_sums) followed by
+    // activation of the whole block. Like mlmvn_forward_base it keeps two
+    // buffers for intermediate results, but each one has room for
+    // max_batch samples of the biggest layer
+    class mlmvn_batch_forward {
+    public:
+        mlmvn_batch_forward(const mlmvn &net, size_t max_batch = 64);
+
+        size_t max_batch() const { return batch; }
+
+        // Calculate output for `count` samples. X holds them one after
+        // another, input_layer_size() values each. out receives
+        // output_layer_size() values per sample in the same order.
+        // count may exceed max_batch(), then samples go in blocks
+        void output(const cmplx *X, size_t count, cmplx *out);
+
+        // The same for samples kept in separate vectors. out is resized
+        void output(const std::vector<cvector> &X, std::vector<cvector> &out);
+
+        // Like output(), but the output layer is not activated: out gets
+        // its weighted sums. Their phases carry more than the activated
+        // outputs, e.g. how far from a sector border they are (see
+        // classifier.h)
+        void weighted_sums(const cmplx *X, size_t count, cmplx *out);
+
+    protected:
+        // Calculate output for up to max_batch samples
+        void output_block(const cmplx *X, size_t count, cmplx *out, bool activate_output = true);
+
+        const mlmvn &net;
+        size_t batch;
+
+        // Two buffers cycling as input and output of layers
+        aligned_cvector layer1, layer2;
+
+        // Packed input and output for output(vector, vector)
+        aligned_cvector packed_in, packed_out;
+    };
+
+    //--------------------------------------------------------------
+
     inline cvector mlmvn::output(const cvector &X) const {
         return mlmvn_forward(*this).output(X);
     }
+
+    inline cvector mlmvn::output(const_cspan X) const {
+        mlmvn_workspace ws(*this);
+
+        return forward(X, ws);
+    }
 };
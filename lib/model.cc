@@ -0,0 +1,275 @@
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "model.h"
+#include "mlmvn.h"
+#include "kernels.h"
+
+using namespace std;
+
+static_assert(sizeof(klogic::model_header) == 64, "model header must take 64 bytes");
+
+namespace {
+    const char MAGIC[8] = "MLMVN";
+
+    uint64_t align_up(uint64_t offset) {
+        return (offset + klogic::WEIGHTS_ALIGNMENT - 1) / klogic::WEIGHTS_ALIGNMENT
+            * klogic::WEIGHTS_ALIGNMENT;
+    }
+
+    void write_at(FILE *file, uint64_t offset, const void *data, size_t size) {
+        if (fseek(file, offset, SEEK_SET) != 0 || fwrite(data, 1, size, file) != size)
+            throw runtime_error("klogic::mlmvn::save(): write failed");
+    }
+}
+
+klogic::model_file::model_file(const string &path)
+    : mapping(0), mapping_size(0)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+
+    if (fd < 0)
+        throw runtime_error("klogic::model_file: can't open " + path);
+
+    struct stat st;
+
+    if (fstat(fd, &st) != 0 || size_t(st.st_size) < sizeof(model_header)) {
+        ::close(fd);
+        throw runtime_error("klogic::model_file: " + path + " is not a model");
+    }
+
+    mapping_size = st.st_size;
+
+    // Private writable mapping: changes go to anonymous copies of pages
+    void *p = mmap(0, mapping_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+
+    // Mapping stays valid after the descriptor is closed
+    ::close(fd);
+
+    if (p == MAP_FAILED)
+        throw runtime_error("klogic::model_file: can't map " + path);
+
+    mapping = static_cast<char *>(p);
+    header  = reinterpret_cast<const model_header *>(mapping);
+    layers  = reinterpret_cast<const model_layer *>(mapping + sizeof(model_header));
+
+    try {
+        validate(path);
+    } catch (...) {
+        munmap(mapping, mapping_size);
+        throw;
+    }
+}
+
+klogic::model_file::~model_file()
+{
+    munmap(mapping, mapping_size);
+}
+
+void klogic::model_file::validate(const string &path) const
+{
+    const char *error = 0;
+
+    if (memcmp(header->magic, MAGIC, sizeof(MAGIC)) != 0)
+        error = " is not a model";
+    else if (header->version != 1 && header->version != MODEL_VERSION)
+        error = " has unsupported version";
+    else if (header->file_size != mapping_size)
+        error = " is truncated";
+    else if ((header->scalar_bytes ? header->scalar_bytes : sizeof(double)) != sizeof(scalar))
+        error = " has weights of other precision";
+    else if (header->layers_count == 0
+             || header->layers_count > (mapping_size - sizeof(model_header)) / sizeof(model_layer))
+        error = " has bad layers count";
+
+    if (error)
+        throw runtime_error("klogic::model_file: " + path + error);
+
+    uint64_t n_neurons = 0;
+
+    for (size_t i = 0; i < layers_count(); ++i) {
+        const model_layer &l = layers[i];
+
+        // Each check keeps the following ones from overflowing
+        uint64_t row_bytes = (layer_inputs(i) + 1) * sizeof(cmplx);
+
+        if (l.size == 0 || l.size > mapping_size || layer_inputs(i) > mapping_size
+            || l.weights_offset % WEIGHTS_ALIGNMENT != 0
+            || l.weights_offset > mapping_size
+            || l.size > (mapping_size - l.weights_offset) / row_bytes)
+            throw runtime_error("klogic::model_file: " + path + " has bad layer table");
+
+        n_neurons += l.size;
+    }
+
+    if (header->k_offset % sizeof(int32_t) != 0 || header->k_offset > mapping_size
+        || n_neurons > (mapping_size - header->k_offset) / sizeof(int32_t))
+        throw runtime_error("klogic::model_file: " + path + " has bad k values offset");
+
+    const int32_t *k = reinterpret_cast<const int32_t *>(mapping + header->k_offset);
+
+    for (uint64_t i = 0; i < n_neurons; ++i) {
+        if (k[i] < 0)
+            throw runtime_error("klogic::model_file: " + path + " has bad k values");
+    }
+
+    if (header->version == 1)
+        return;
+
+    if (header->periods_offset % sizeof(int32_t) != 0 || header->periods_offset > mapping_size
+        || n_neurons > (mapping_size - header->periods_offset) / sizeof(int32_t))
+        throw runtime_error("klogic::model_file: " + path + " has bad periods offset");
+
+    const int32_t *l = reinterpret_cast<const int32_t *>(mapping + header->periods_offset);
+
+    // Periodic neurons are discrete and have root tables
+    for (uint64_t i = 0; i < n_neurons; ++i) {
+        if (l[i] < 1 || (l[i] > 1 && (k[i] == 0 || k[i] > kernels::MAX_ROOTS_K / l[i])))
+            throw runtime_error("klogic::model_file: " + path + " has bad periods");
+    }
+}
+
+vector<int> klogic::model_file::sizes() const
+{
+    vector<int> result(1, input_size());
+
+    for (size_t i = 0; i < layers_count(); ++i)
+        result.push_back(layers[i].size);
+
+    return result;
+}
+
+const int32_t *klogic::model_file::k_values(size_t layer) const
+{
+    assert(layer < layers_count());
+
+    const int32_t *k = reinterpret_cast<const int32_t *>(mapping + header->k_offset);
+
+    for (size_t i = 0; i < layer; ++i)
+        k += layers[i].size;
+
+    return k;
+}
+
+const int32_t *klogic::model_file::periods(size_t layer) const
+{
+    assert(layer < layers_count());
+
+    if (header->version == 1)
+        return 0;
+
+    const int32_t *l = reinterpret_cast<const int32_t *>(mapping + header->periods_offset);
+
+    for (size_t i = 0; i < layer; ++i)
+        l += layers[i].size;
+
+    return l;
+}
+
+klogic::weights_view klogic::model_file::weights(size_t layer) const
+{
+    assert(layer < layers_count());
+
+    const model_layer &l = layers[layer];
+
+    return weights_view(reinterpret_cast<cmplx *>(mapping + l.weights_offset),
+                        l.size * (layer_inputs(layer) + 1));
+}
+
+/*
+ * mlmvn persistence
+ */
+
+klogic::mlmvn::mlmvn(const string &path, model_storage storage)
+{
+    std::shared_ptr<model_file> file = std::make_shared<model_file>(path);
+
+    set_topology(file->sizes());
+
+    for (size_t layer = 0; layer < layers_count(); ++layer) {
+        weights_view w = file->weights(layer);
+
+        if (storage == MODEL_MAP)
+            weights[layer] = w;
+        else {
+            own_weights[layer].assign(w.begin(), w.end());
+            weights[layer] = weights_view(own_weights[layer].data(), own_weights[layer].size());
+        }
+
+        const int32_t *k = file->k_values(layer);
+        const int32_t *l = file->periods(layer);
+
+        bind_layer(layer, vector<int>(k, k + layer_size(layer)),
+                   l ? vector<int>(l, l + layer_size(layer)) : vector<int>(layer_size(layer), 1));
+    }
+
+    // Otherwise file is unmapped right here
+    if (storage == MODEL_MAP)
+        mapped_model = file;
+}
+
+void klogic::mlmvn::save(const string &path) const
+{
+    size_t n_weights, n_neurons;
+
+    get_stats(n_weights, n_neurons);
+
+    model_header header;
+    vector<model_layer> layers(layers_count());
+    vector<int32_t> k_values, periods;
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, MAGIC, sizeof(MAGIC));
+
+    header.version      = MODEL_VERSION;
+    header.layers_count = layers_count();
+    header.input_size   = input_size;
+    header.k_offset     = sizeof(model_header) + layers.size() * sizeof(model_layer);
+
+    header.periods_offset = header.k_offset + n_neurons * sizeof(int32_t);
+
+    uint64_t offset = header.periods_offset + n_neurons * sizeof(int32_t);
+
+    for (size_t layer = 0; layer < layers_count(); ++layer) {
+        offset = align_up(offset);
+
+        layers[layer].size = layer_size(layer);
+        layers[layer].weights_offset = offset;
+
+        offset += weights[layer].size() * sizeof(cmplx);
+
+        for (size_t i = 0; i < layer_size(layer); ++i) {
+            k_values.push_back(neurons[layer][i].k_value());
+            periods.push_back(neurons[layer][i].l_value());
+        }
+    }
+
+    header.file_size    = offset;
+    header.scalar_bytes = sizeof(scalar);
+
+    FILE *file = fopen(path.c_str(), "wb");
+
+    if (!file)
+        throw runtime_error("klogic::mlmvn::save(): can't create " + path);
+
+    try {
+        write_at(file, 0, &header, sizeof(header));
+        write_at(file, sizeof(header), layers.data(), layers.size() * sizeof(model_layer));
+        write_at(file, header.k_offset, k_values.data(), k_values.size() * sizeof(int32_t));
+        write_at(file, header.periods_offset, periods.data(), periods.size() * sizeof(int32_t));
+
+        for (size_t layer = 0; layer < layers_count(); ++layer)
+            write_at(file, layers[layer].weights_offset, weights[layer].data(),
+                     weights[layer].size() * sizeof(cmplx));
+    } catch (...) {
+        fclose(file);
+        throw;
+    }
+
+    if (fclose(file) != 0)
+        throw runtime_error("klogic::mlmvn::save(): write failed");
+}
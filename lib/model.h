@@ -0,0 +1,88 @@
+// Binary MLMVN model file
+//
+// Layout (native byte order, offsets from file start):
+//
+//   0     model_header, 64 bytes
+//   64    model_layer for each layer: size and offset of its weights
+//   ...   k values, int32 per neuron, layer by layer
+//   ...   periods (l of MVN-P, 1 for MVN), int32 per neuron, layer by
+//         layer; version 2 only
+//   ...   weights of each layer at WEIGHTS_ALIGNMENT-aligned offset,
+//         packed as mlmvn::layer_weights(): klogic::cmplx rows of
+//         inputs+1 weights, bias first. Files saved by the float build
+//         (KLOGIC_FLOAT) hold complex<float>, see scalar_bytes
+//
+// Weight blocks are aligned, so a mapped file is used as packed layer
+// storage as is (see mlmvn(path, MODEL_MAP))
+#pragma once
+
+#include <string>
+#include <stdint.h>
+#include "klogic.h"
+#include "storage.h"
+
+namespace klogic {
+    struct model_header {
+        char     magic[8];          // "MLMVN\0\0\0"
+        uint32_t version;
+        uint32_t layers_count;
+        uint64_t input_size;
+        uint64_t k_offset;          // k values
+        uint64_t file_size;
+        uint32_t scalar_bytes;      // sizeof(scalar) of weights, 0 means 8
+        uint32_t reserved;
+        uint64_t periods_offset;    // periods, version 2
+        char     padding[8];
+    };
+
+    struct model_layer {
+        uint64_t size;              // neurons count
+        uint64_t weights_offset;
+    };
+
+    // Version 2 adds periods. Version 1 files are still read, all their
+    // neurons have l = 1
+    const uint32_t MODEL_VERSION = 2;
+
+    // Model file mapped to memory, validated on open. Pages are private
+    // copy-on-write, so weights may be changed without touching the file.
+    // Errors are reported with std::runtime_error
+    class model_file {
+    public:
+        model_file(const std::string &path);
+        ~model_file();
+
+        size_t layers_count() const { return header->layers_count; }
+        size_t input_size() const   { return header->input_size; }
+
+        // Sizes as given to mlmvn constructor: inputs count, then
+        // layer sizes
+        std::vector<int> sizes() const;
+
+        // k values of a layer's neurons
+        const int32_t *k_values(size_t layer) const;
+
+        // Periods of a layer's neurons, 0 for version 1 files
+        const int32_t *periods(size_t layer) const;
+
+        // Packed weights of a layer
+        weights_view weights(size_t layer) const;
+
+    private:
+        // Non-copyable
+        model_file(const model_file &);
+        model_file &operator=(const model_file &);
+
+        void validate(const std::string &path) const;
+
+        size_t layer_inputs(size_t i) const {
+            return i == 0 ? input_size() : layers[i - 1].size;
+        }
+
+        char *mapping;
+        size_t mapping_size;
+
+        const model_header *header;
+        const model_layer  *layers;
+    };
+}
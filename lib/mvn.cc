@@ -1,35 +1,76 @@
 // #include <iostream>
 #include "mvn.h"
+#include "kernels.h"
 #include <cstdlib>
+#include <algorithm>
+#include <stdexcept>
 
 using namespace std;
 
-klogic::mvn::mvn(int k, int N)
-    : weights(N + 1)
+klogic::mvn::mvn(int k, int N, int l)
+    : own_weights(N + 1), weights(own_weights.data(), N + 1)
 {
     assert(k >= 0 && N >= 0);
+
+    if (l < 1 || (l > 1 && (k == 0 || k > kernels::MAX_ROOTS_K / l)))
+        throw std::invalid_argument("klogic::mvn: bad periods of activation");
+
     this->k = k;
+    this->l = l;
 
-    // Randomize weights
-    for (cvector::iterator i = weights.begin(); i != weights.end(); ++i)
-        *i = cmplx(double(rand()) / RAND_MAX, double(rand()) / RAND_MAX);
+    randomize();
 }
 
-//-------------------------------------------------------------------------
+klogic::mvn::mvn(const mvn &other)
+    : own_weights(other.weights.begin(), other.weights.end()),
+      weights(own_weights.data(), own_weights.size()),
+      k(other.k), l(other.l)
+{
+}
+
+klogic::mvn &klogic::mvn::operator=(const mvn &other)
+{
+    if (this == &other)
+        return *this;
+
+    k = other.k;
+    l = other.l;
+
+    if (is_bound()) {
+        assert(weights.size() == other.weights.size());
+        copy(other.weights.begin(), other.weights.end(), weights.begin());
+    } else {
+        own_weights.assign(other.weights.begin(), other.weights.end());
+        weights = weights_view(own_weights.data(), own_weights.size());
+    }
+
+    return *this;
+}
+
+void klogic::mvn::bind(int k, cmplx *storage, int N, int l)
+{
+    assert(k >= 0 && N >= 0 && l >= 1);
+    this->k = k;
+    this->l = l;
+
+    own_weights.clear();
+    weights = weights_view(storage, N + 1);
+}
 
-klogic::cmplx klogic::mvn::weighted_sum(
-    klogic::cvector::const_iterator Xbeg,
-    klogic::cvector::const_iterator Xend) const
+void klogic::mvn::randomize()
 {
-    assert(weights.size() == Xend - Xbeg + 1);
+    for (weights_view::iterator i = weights.begin(); i != weights.end(); ++i)
+        *i = cmplx(double(rand()) / RAND_MAX, double(rand()) / RAND_MAX);
+}
 
-    cvector::const_iterator w = weights.begin(), x = Xbeg;
-    cmplx z = *w++;         // bias
+//-------------------------------------------------------------------------
 
-    while (w != weights.end())
-        z += (*w++) * (*x++);   // pairwise multiply and summate
+klogic::cmplx klogic::mvn::weighted_sum(klogic::const_cspan X) const
+{
+    assert(weights.size() == X.size() + 1);
 
-    return z;
+    // bias + pairwise multiply and summate
+    return weights[0] + kernels::dot(weights.begin() + 1, X.begin(), X.size());
 }
 
 //-------------------------------------------------------------------------
@@ -37,24 +78,84 @@ void klogic::mvn::learn(cvector::const_iterator Xbeg,
                         cvector::const_iterator Xend,
                         const cmplx &error, double learning_rate, bool variable_rate)
 {
-    assert(weights.size() == Xend - Xbeg + 1);
+    learn(span(Xbeg, Xend), error, learning_rate, variable_rate);
+}
+
+void klogic::mvn::learn(const_cspan X, const cmplx &error,
+                        double learning_rate, bool variable_rate)
+{
+    assert(weights.size() == X.size() + 1);
+
+    cmplx z = variable_rate || l > 1 ? weighted_sum(X) : cmplx(0);
+
+    correct(X, learning_factor(periodic_error(z, error), learning_rate, variable_rate, z));
+}
+
+klogic::cmplx klogic::mvn::periodic_error(const cmplx &z, const cmplx &error) const
+{
+    if (l == 1)
+        return error;
+
+    int m = k * l;
+    int s = kernels::sector_number(m, z) % m;
+
+    // NaN sum, nothing to learn
+    if (s < 0)
+        return cmplx(0);
 
-    cmplx factor = error * learning_rate / (double)weights.size(); // division by N+1
+    // Sector starts, i.e. m-th roots
+    const cmplx *roots = kernels::roots_of_unity(m);
+
+    // Phases of z giving the desired output are (phase(desired) +
+    // 2pi*p) / l, p = 0..l-1; pick the one nearest to sector s
+    double base = phase(kernels::periodic_roots(k, l)[s] + error) / l;
+    double step = TWOPI / l;
+    int p = int(std::floor((TWOPI * s / m - base) / step + 0.5)) % l;
+
+    return std::polar(scalar(1), scalar(base + p * step)) - roots[s];
+}
+
+klogic::cmplx klogic::mvn::learning_factor(const cmplx &error, double learning_rate,
+                                           bool variable_rate, const cmplx &z) const
+{
+    cmplx factor = error * scalar(learning_rate) / scalar(weights.size()); // division by N+1
 
     if (variable_rate)
-        factor /= std::abs(weighted_sum(Xbeg, Xend));
+        factor /= std::abs(z);
+
+    return factor;
+}
 
-    cvector::iterator       w = weights.begin();
-    cvector::const_iterator x = Xbeg;
+void klogic::mvn::correct(const_cspan X, const cmplx &factor)
+{
+    assert(weights.size() == X.size() + 1);
 
-    // cout << "learn(): error=" << error << " factor=" << factor << "weights before: " << weights_vector() << endl;
+    // cout << "learn(): factor=" << factor << "weights before: " << weights_vector() << endl;
 
-    *w++ += factor;         // change bias
+    weights[0] += factor;   // change bias
 
-    for (; w != weights.end(); w++, x++) {
-        *w += factor * std::conj(*x);
-    }
+    kernels::add_conj_scaled(weights.begin() + 1, factor, X.begin(), X.size());
 
     // cout << "learn(): weights after: " << weights_vector() << endl;
+}
+
+void klogic::mvn::accumulate(const_cspan X, const cmplx &error, mvn_gradient &g,
+                             double learning_rate, bool variable_rate) const
+{
+    assert(g.weights.size() == weights.size());
+
+    cmplx z = variable_rate || l > 1 ? weighted_sum(X) : cmplx(0);
+    cmplx factor = learning_factor(periodic_error(z, error), learning_rate, variable_rate, z);
+
+    g.weights[0] += factor;
+
+    kernels::add_conj_scaled(&g.weights[1], factor, X.begin(), X.size());
+}
+
+void klogic::mvn::apply(const mvn_gradient &g, double scale)
+{
+    assert(g.weights.size() == weights.size());
 
+    for (size_t i = 0; i < weights.size(); ++i)
+        weights[i] += scalar(scale) * g.weights[i];
 }
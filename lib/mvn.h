@@ -1,26 +1,53 @@
 // Single MVN implementation
+//
+// A discrete neuron may have periodic activation (MVN-P): its weighted
+// sum falls into one of m = k*l sectors and sector s gives
+// epsilon(s mod k, k), so the k values repeat l times around the circle.
+// One such neuron learns functions which are not k-valued threshold ones
+// and would need a hidden layer of plain MVNs. l == 1 is ordinary MVN
 #pragma once
 
 #include "klogic.h"
+#include "storage.h"
+#include "kernels.h"
 
 namespace klogic {
+    class mlmvn;
+    class mvn_gradient;
 
     class mvn {
+        friend class mlmvn;
     public:
         typedef cmplx desired_type;
+        typedef mvn_gradient gradient_type;
 
         // Create mvn in k-valued logic with N inputs.
-        // This counts for N+1 weights, including bias.
-        mvn(int k, int N);
-        mvn() : k(-1) {}
+        // This counts for N+1 weights, including bias. l > 1 makes
+        // MVN-P with l periods, throws std::invalid_argument unless it's
+        // discrete and k*l <= kernels::MAX_ROOTS_K
+        mvn(int k, int N, int l = 1);
+        mvn() : k(-1), l(1) {}
+
+        // Copy always gets its own weights, even if other neuron keeps
+        // them in mlmvn layer storage
+        mvn(const mvn &other);
+
+        // Neuron bound to mlmvn layer storage writes weights through to it,
+        // so sizes must match in this case
+        mvn &operator=(const mvn &other);
 
         // Applies activation function to weighted sum
-        cmplx output(const cvector &X) const {
-            return activation(k, weighted_sum(X.begin(), X.end()));
+        cmplx output(const_cspan X) const {
+            return activation(weighted_sum(X));
         }
 
         cmplx output(cvector::const_iterator xbeg, cvector::const_iterator xend) const {
-            return activation(k, weighted_sum(xbeg, xend));
+            return activation(weighted_sum(span(xbeg, xend)));
+        }
+
+        // Activation function of this neuron for weighted sum z
+        cmplx activation(const cmplx &z) const {
+            return l == 1 ? kernels::activation(k, z) : kernels::periodic_activation(k, l, z);
         }
 
         // Returns true if this neuron is discrete
@@ -29,6 +56,11 @@ namespace klogic {
         // Returns k
         int k_value() const { return k; }
 
+        // Periods of activation, 1 unless this is MVN-P
+        int l_value() const { return l; }
+
+        bool is_periodic() const { return l > 1; }
+
         // Uses Error-Correction Learning Rule (3.92) to
         // change weights. If variable_rate is true,
         // additional division by |z| is done per (3.94)
@@ -36,14 +68,42 @@ namespace klogic {
                    const cmplx &error, double learning_rate = 1.0,
                    bool variable_rate = false);
 
-        void learn(const cvector &X, const cmplx &error,
-                   double learning_rate = 1.0, bool variable_rate = false) {
-            learn(X.begin(), X.end(), error, learning_rate, variable_rate);
-        }
+        void learn(const_cspan X, const cmplx &error,
+                   double learning_rate = 1.0, bool variable_rate = false);
+
+        // MVN-P learning rule: of the l sectors giving output
+        // activation(z)+error the one nearest to the sector of z is the
+        // target, and the error of the weighted sum is the difference of
+        // their m-th roots (m = k*l). For continuous desired values (as
+        // backpropagated errors are) the target is the nearest of l
+        // phases. learn() corrects weights by this error. Returns error
+        // as is for l == 1
+        cmplx periodic_error(const cmplx &z, const cmplx &error) const;
+
+        // Factor of the correction learn() makes. z is weighted sum of the
+        // input, used only if variable_rate is true
+        cmplx learning_factor(const cmplx &error, double learning_rate,
+                              bool variable_rate, const cmplx &z) const;
+
+        // Adds factor to bias and factor*conj(x_i) to other weights. This
+        // changes weighted sum of X by factor*(1 + |x_1|^2 + ... + |x_N|^2)
+        void correct(const_cspan X, const cmplx &factor);
+
+        // Add correction learn() would make to g instead of changing
+        // weights (batch learning)
+        void accumulate(const_cspan X, const cmplx &error, mvn_gradient &g,
+                        double learning_rate = 1.0, bool variable_rate = false) const;
+
+        // Add scale*g to weights
+        void apply(const mvn_gradient &g, double scale = 1.0);
 
-        // Returns weights
-        const cvector &weights_vector() const { return weights; }
-        cvector &weights_vector()             { return weights; }
+        // Returns weights. For neurons in mlmvn it's a view into packed
+        // layer storage
+        const_weights_view weights_vector() const { return weights; }
+        weights_view weights_vector()             { return weights; }
+
+        // Fills weights with random values in [0..1] x [0..1]
+        void randomize();
 
         // Returns weight which corresponds to i-th input of this neuron
         cmplx weight_for_input(int i) const {
@@ -54,10 +114,33 @@ namespace klogic {
         }
 
     protected:
-        cvector weights;
-        int k;
+        // Own storage of standalone neuron. Empty if weights are bound to
+        // external storage
+        aligned_cvector own_weights;
+        weights_view weights;
+        int k, l;
         /**************/
+        // Make this neuron use N+1 weights from external storage
+        void bind(int k, cmplx *storage, int N, int l = 1);
+
+        bool is_bound() const {
+            return weights.data() != 0 && weights.data() != own_weights.data();
+        }
+
         // Calculates w_0+w_1*i_1+....+w_N*i_N
-        cmplx weighted_sum(cvector::const_iterator xbeg, cvector::const_iterator xend) const;
+        cmplx weighted_sum(const_cspan X) const;
+
+        static const_cspan span(cvector::const_iterator xbeg, cvector::const_iterator xend) {
+            return xbeg == xend ? const_cspan() : const_cspan(&*xbeg, xend - xbeg);
+        }
+    };
+
+    // Weight corrections accumulated over several samples
+    class mvn_gradient {
+    public:
+        mvn_gradient(const mvn &neuron)
+            : weights(neuron.weights_vector().size()) {}
+
+        cvector weights;
     };
 }
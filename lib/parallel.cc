@@ -0,0 +1,56 @@
+#include "parallel.h"
+
+klogic::mlmvn_parallel_learner::mlmvn_parallel_learner(klogic::mlmvn &_net)
+    : net(_net)
+{
+}
+
+void klogic::mlmvn_parallel_learner::prepare(int n)
+{
+    while (workspaces.size() < size_t(n)) {
+        workspaces.push_back(mlmvn_workspace(net));
+        gradients.push_back(mlmvn_gradient(net));
+    }
+
+    picked.assign(n, 0);
+
+    for (int t = 0; t < n; ++t)
+        gradients[t].clear();
+}
+
+void klogic::mlmvn_parallel_learner::reduce(int n)
+{
+    int nthreads = net.parallel().thread_count();
+
+    for (size_t layer = 0; layer < net.layers_count(); ++layer) {
+        aligned_cvector &to = gradients[0].layers[layer];
+        long size = to.size();
+
+        // Each weight is summed over threads in order 1, 2, ..., n-1, so
+        // splitting the weights between threads doesn't change the result
+#pragma omp parallel for num_threads(nthreads) schedule(static) if(size >= 4096)
+        for (long i = 0; i < size; ++i) {
+            cmplx sum = to[i];
+
+            for (int t = 1; t < n; ++t)
+                sum += gradients[t].layers[layer][i];
+
+            to[i] = sum;
+        }
+    }
+}
+
+//-------------------------------------------------------------------------
+
+klogic::mlmvn_hogwild_learner::mlmvn_hogwild_learner(klogic::mlmvn &_net)
+    : net(_net)
+{
+}
+
+void klogic::mlmvn_hogwild_learner::prepare(int n)
+{
+    while (workspaces.size() < size_t(n))
+        workspaces.push_back(mlmvn_workspace(net));
+
+    picked.assign(n, 0);
+}
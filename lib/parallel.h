@@ -0,0 +1,220 @@
+// Data-parallel mini-batch learning for MLMVN
+#pragma once
+
+#include <vector>
+#include "mlmvn.h"
+#include "learning.h"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace klogic {
+    // Mini-batch learning which splits every batch between threads. Each
+    // thread has its own workspace and gradient, so the network is only
+    // read until the batch is done. Then partial gradients are summed in
+    // thread order and the averaged correction is applied once. With the
+    // same thread count results don't depend on scheduling.
+    //
+    // Thread count and per-layer parallelism settings are taken from
+    // net.parallel()
+    class mlmvn_parallel_learner {
+    public:
+        mlmvn_parallel_learner(mlmvn &net);
+
+        // Learn one batch of samples [first, last). Iterator is a random
+        // access iterator over learning::sample<cvector>-like objects.
+        // picker is applied to each sample and its actual output, as in
+        // teacher::learn_run. Returns number of samples picked
+        template<typename Iterator, typename SamplePicker, typename LearnError>
+        size_t learn_batch(Iterator first, Iterator last,
+                           SamplePicker const &picker, LearnError const &learn_error,
+                           double learning_rate = 1.0);
+
+        template<typename Iterator, typename SamplePicker>
+        size_t learn_batch(Iterator first, Iterator last, SamplePicker const &picker) {
+            return learn_batch(first, last, picker, learning::learn_error<cvector>());
+        }
+
+        // Learn [first, last) in batches of batch_size samples. Returns
+        // number of samples picked
+        template<typename Iterator, typename SamplePicker>
+        size_t learn_run(Iterator first, Iterator last, size_t batch_size,
+                         SamplePicker const &picker = SamplePicker()) {
+            assert(batch_size > 0);
+
+            size_t picked = 0;
+
+            for (Iterator i = first; i < last; ) {
+                Iterator batch_end = (last - i > long(batch_size)) ? i + batch_size : last;
+
+                picked += learn_batch(i, batch_end, picker);
+                i = batch_end;
+            }
+
+            return picked;
+        }
+
+    protected:
+        // Make sure there are workspaces and gradients for n threads and
+        // clear gradients
+        void prepare(int n);
+
+        // Sum first n gradients into the first one, in fixed order
+        void reduce(int n);
+
+        mlmvn &net;
+
+        std::vector<mlmvn_workspace> workspaces;
+        std::vector<mlmvn_gradient>  gradients;
+        std::vector<size_t>          picked;
+    };
+
+    //--------------------------------------------------------------
+
+    // Asynchronous online learning without locks (Hogwild). Samples are
+    // split between threads and every thread runs the usual per-sample
+    // rule (forward(), then learn_forwarded() without refreshing the cache
+    // of reciprocals: (4.121)/(4.122) errors and mvn corrections) on the
+    // shared weights. Each thread has its own workspace, so sums, outputs
+    // and errors are private, but weights are read and corrected while
+    // other threads correct them. Updates may interleave or be lost,
+    // results depend on scheduling and aren't reproducible. This pays off
+    // when corrections of different samples rarely touch the same weights.
+    //
+    // Thread count is taken from net.parallel(). Layers are not split
+    // between threads any more (nested parallel regions run serially)
+    class mlmvn_hogwild_learner {
+    public:
+        mlmvn_hogwild_learner(mlmvn &net);
+
+        // Learn samples [first, last) once. Iterator is a random access
+        // iterator over learning::sample<cvector>-like objects. picker is
+        // applied to each sample and its actual output, as in
+        // teacher::learn_run. Returns number of samples picked
+        template<typename Iterator, typename SamplePicker, typename LearnError>
+        size_t learn_run(Iterator first, Iterator last,
+                         SamplePicker const &picker, LearnError const &learn_error,
+                         double learning_rate = 1.0);
+
+        template<typename Iterator, typename SamplePicker>
+        size_t learn_run(Iterator first, Iterator last, SamplePicker const &picker = SamplePicker()) {
+            return learn_run(first, last, picker, learning::learn_error<cvector>());
+        }
+
+    protected:
+        // Make sure there are workspaces for n threads
+        void prepare(int n);
+
+        mlmvn &net;
+
+        std::vector<mlmvn_workspace> workspaces;
+        std::vector<size_t>          picked;
+    };
+
+    //--------------------------------------------------------------
+
+    template<typename Iterator, typename SamplePicker, typename LearnError>
+    size_t mlmvn_parallel_learner::learn_batch(Iterator first, Iterator last,
+                                               SamplePicker const &picker,
+                                               LearnError const &learn_error,
+                                               double learning_rate)
+    {
+        long count = last - first;
+        int nthreads = net.parallel().thread_count();
+
+        if (count <= 0)
+            return 0;
+
+        if (nthreads > count)
+            nthreads = count;
+
+        prepare(nthreads);
+
+        // Threads only read the cache of reciprocal weights
+        net.update_reciprocals();
+
+        // Batch is cut into nthreads contiguous parts, part t goes to
+        // gradient t whichever thread runs it
+#pragma omp parallel for num_threads(nthreads) schedule(static, 1)
+        for (int t = 0; t < nthreads; ++t) {
+            mlmvn_workspace &ws = workspaces[t];
+            mlmvn_gradient  &g  = gradients[t];
+
+            long part_end = count * (t + 1) / nthreads;
+
+            for (long s = count * t / nthreads; s < part_end; ++s) {
+                const typename std::iterator_traits<Iterator>::value_type &sample = first[s];
+                const cvector &actual = net.forward(sample.input, ws);
+
+                if (picker(sample, actual)) {
+                    net.accumulate(sample.input, learn_error(actual, sample.desired),
+                                   learning_rate, ws, g);
+                    ++picked[t];
+                }
+            }
+        }
+
+        size_t total = 0;
+
+        for (int t = 0; t < nthreads; ++t)
+            total += picked[t];
+
+        if (total > 0) {
+            reduce(nthreads);
+            net.apply(gradients[0], 1.0 / total);
+        }
+
+        return total;
+    }
+
+    //--------------------------------------------------------------
+
+    template<typename Iterator, typename SamplePicker, typename LearnError>
+    size_t mlmvn_hogwild_learner::learn_run(Iterator first, Iterator last,
+                                            SamplePicker const &picker,
+                                            LearnError const &learn_error,
+                                            double learning_rate)
+    {
+        long count = last - first;
+        int nthreads = net.parallel().thread_count();
+
+        if (count <= 0)
+            return 0;
+
+        if (nthreads > count)
+            nthreads = count;
+
+        prepare(nthreads);
+
+        // Rows of the cache are refreshed by learn_forwarded_fresh(),
+        // stale layers must be refreshed before threads start
+        net.update_reciprocals();
+
+        // Thread t learns contiguous part t of the samples
+#pragma omp parallel for num_threads(nthreads) schedule(static, 1)
+        for (int t = 0; t < nthreads; ++t) {
+            mlmvn_workspace &ws = workspaces[t];
+
+            long part_end = count * (t + 1) / nthreads;
+
+            for (long s = count * t / nthreads; s < part_end; ++s) {
+                const typename std::iterator_traits<Iterator>::value_type &sample = first[s];
+                const cvector &actual = net.forward(sample.input, ws);
+
+                if (picker(sample, actual)) {
+                    net.learn_forwarded_fresh(sample.input, learn_error(actual, sample.desired),
+                                              learning_rate, ws);
+                    ++picked[t];
+                }
+            }
+        }
+
+        size_t total = 0;
+
+        for (int t = 0; t < nthreads; ++t)
+            total += picked[t];
+
+        return total;
+    }
+}
@@ -0,0 +1,112 @@
+// Optional instrumentation of learning. Counters are updated only if the
+// library is built with KLOGIC_PROFILE (CMake option MVN_PROFILE),
+// otherwise they stay zero and the hot paths have no extra code
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+namespace klogic {
+#ifdef KLOGIC_PROFILE
+    const bool PROFILING = true;
+#else
+    const bool PROFILING = false;
+#endif
+
+    // Counters of one network layer
+    struct layer_profile {
+        // Time of forward pass, error backpropagation and weights
+        // correction (or accumulation for batch learning)
+        double forward_seconds, backward_seconds, update_seconds;
+
+        // Weighted sums of neurons calculated
+        uint64_t weighted_sums;
+
+        // Complex divisions of error backpropagation, including
+        // reciprocals of weights refreshed after correction
+        uint64_t divisions;
+
+        // Neurons corrected
+        uint64_t corrections;
+
+        layer_profile()
+            : forward_seconds(0), backward_seconds(0), update_seconds(0),
+              weighted_sums(0), divisions(0), corrections(0) {}
+    };
+
+    // Counters kept in a learning workspace (see mlmvn_workspace and
+    // learning::teacher)
+    struct learning_profile {
+        // Indexed as mlmvn layers, empty for a single neuron
+        std::vector<layer_profile> layers;
+
+        // learn_forwarded() and accumulate() calls
+        uint64_t learn_calls;
+
+        // Samples the teacher's picker skipped
+        uint64_t skipped_samples;
+
+        learning_profile(size_t nlayers = 0)
+            : layers(nlayers), learn_calls(0), skipped_samples(0) {}
+
+        // Set all counters to zero
+        void clear() {
+            std::fill(layers.begin(), layers.end(), layer_profile());
+            learn_calls = skipped_samples = 0;
+        }
+
+        // Add counters of other profile with the same layers count
+        void add(const learning_profile &other);
+    };
+
+    inline void learning_profile::add(const learning_profile &other)
+    {
+        for (size_t i = 0; i < layers.size() && i < other.layers.size(); ++i) {
+            layer_profile &to = layers[i];
+            const layer_profile &from = other.layers[i];
+
+            to.forward_seconds  += from.forward_seconds;
+            to.backward_seconds += from.backward_seconds;
+            to.update_seconds   += from.update_seconds;
+            to.weighted_sums    += from.weighted_sums;
+            to.divisions        += from.divisions;
+            to.corrections      += from.corrections;
+        }
+
+        learn_calls     += other.learn_calls;
+        skipped_samples += other.skipped_samples;
+    }
+
+#ifdef KLOGIC_PROFILE
+    // Adds time of its scope to a counter
+    class profile_timer {
+    public:
+        explicit profile_timer(double &_seconds)
+            : seconds(_seconds), start(std::chrono::steady_clock::now()) {}
+
+        ~profile_timer() {
+            seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        }
+
+    private:
+        // Non-copyable
+        profile_timer(const profile_timer &);
+        profile_timer &operator=(const profile_timer &);
+
+        double &seconds;
+        std::chrono::steady_clock::time_point start;
+    };
+#endif
+}
+
+// Instrumentation statements. Arguments are not evaluated without
+// KLOGIC_PROFILE
+#ifdef KLOGIC_PROFILE
+#define KLOGIC_PROFILE_TIME(seconds)    klogic::profile_timer klogic_profile_timer(seconds)
+#define KLOGIC_PROFILE_ADD(counter, n)  ((counter) += (n))
+#else
+#define KLOGIC_PROFILE_TIME(seconds)    ((void)0)
+#define KLOGIC_PROFILE_ADD(counter, n)  ((void)0)
+#endif
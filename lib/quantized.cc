@@ -0,0 +1,311 @@
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include "quantized.h"
+#include "kernels.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define KLOGIC_X86_DISPATCH
+#include <immintrin.h>
+#endif
+
+using namespace std;
+using klogic::quantized_traits;
+
+namespace {
+    // Fixed-point value of x in [-1..1] scaled to [-max..max]
+    template<typename T>
+    T fixed(double x, double scale) {
+        return T(lround(x * scale));
+    }
+
+    // re = w.a and im = w.b for n values (n/2 complex numbers)
+    template<typename Weight>
+    struct dot_kernel {
+        typedef typename quantized_traits<Weight>::accumulator accumulator;
+
+        typedef void (*function)(const Weight *w, const int16_t *a, const int16_t *b,
+                                 size_t n, accumulator &re, accumulator &im);
+    };
+
+    // Plain version. Products fit in product type, see quantized_traits
+    template<typename Weight>
+    void dot_scalar(const Weight *w, const int16_t *a, const int16_t *b, size_t n,
+                    typename dot_kernel<Weight>::accumulator &re,
+                    typename dot_kernel<Weight>::accumulator &im)
+    {
+        typedef typename quantized_traits<Weight>::product product;
+
+        for (size_t i = 0; i < n; ++i) {
+            re += product(w[i]) * a[i];
+            im += product(w[i]) * b[i];
+        }
+    }
+
+#ifdef KLOGIC_X86_DISPATCH
+    __attribute__((target("avx2")))
+    inline int64_t sum_epi64(__m256i v)
+    {
+        __m128i s = _mm_add_epi64(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+
+        return _mm_cvtsi128_si64(s) + _mm_extract_epi64(s, 1);
+    }
+
+    __attribute__((target("avx2")))
+    inline int32_t sum_epi32(__m256i v)
+    {
+        __m128i s = _mm_add_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+
+        s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0x4E));
+        s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0xB1));
+
+        return _mm_cvtsi128_si32(s);
+    }
+
+    // Pairs of 16-bit products summed to 32 bits fit (2 * 32767^2), but
+    // more of them don't, so they are widened to 64 bits right away
+    __attribute__((target("avx2")))
+    void dot_avx2(const int16_t *w, const int16_t *a, const int16_t *b, size_t n,
+                  int64_t &re, int64_t &im)
+    {
+        __m256i acc_re = _mm256_setzero_si256(), acc_im = _mm256_setzero_si256();
+        size_t i = 0;
+
+        for (; i + 16 <= n; i += 16) {
+            __m256i wv = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(w + i));
+            __m256i r  = _mm256_madd_epi16(wv, _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a + i)));
+            __m256i m  = _mm256_madd_epi16(wv, _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b + i)));
+
+            acc_re = _mm256_add_epi64(acc_re, _mm256_cvtepi32_epi64(_mm256_castsi256_si128(r)));
+            acc_re = _mm256_add_epi64(acc_re, _mm256_cvtepi32_epi64(_mm256_extracti128_si256(r, 1)));
+            acc_im = _mm256_add_epi64(acc_im, _mm256_cvtepi32_epi64(_mm256_castsi256_si128(m)));
+            acc_im = _mm256_add_epi64(acc_im, _mm256_cvtepi32_epi64(_mm256_extracti128_si256(m, 1)));
+        }
+
+        re += sum_epi64(acc_re);
+        im += sum_epi64(acc_im);
+
+        dot_scalar<int16_t>(w + i, a + i, b + i, n - i, re, im);
+    }
+
+    // 8-bit weights are widened to 16 bits. Sums stay in 32 bits, the
+    // inputs count is limited by quantized_mlmvn constructor
+    __attribute__((target("avx2")))
+    void dot_avx2(const int8_t *w, const int16_t *a, const int16_t *b, size_t n,
+                  int32_t &re, int32_t &im)
+    {
+        __m256i acc_re = _mm256_setzero_si256(), acc_im = _mm256_setzero_si256();
+        size_t i = 0;
+
+        for (; i + 16 <= n; i += 16) {
+            __m256i wv = _mm256_cvtepi8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(w + i)));
+
+            acc_re = _mm256_add_epi32(acc_re,
+                _mm256_madd_epi16(wv, _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a + i))));
+            acc_im = _mm256_add_epi32(acc_im,
+                _mm256_madd_epi16(wv, _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b + i))));
+        }
+
+        re += sum_epi32(acc_re);
+        im += sum_epi32(acc_im);
+
+        dot_scalar<int8_t>(w + i, a + i, b + i, n - i, re, im);
+    }
+#endif
+
+    // The best version for this CPU
+    template<typename Weight>
+    typename dot_kernel<Weight>::function best_dot()
+    {
+#ifdef KLOGIC_X86_DISPATCH
+        __builtin_cpu_init();
+
+        if (__builtin_cpu_supports("avx2"))
+            return static_cast<typename dot_kernel<Weight>::function>(&dot_avx2);
+#endif
+
+        return &dot_scalar<Weight>;
+    }
+}
+
+//-------------------------------------------------------------------------
+
+template<typename Weight>
+klogic::quantized_mlmvn<Weight>::quantized_mlmvn(const mlmvn &net, int input_k)
+    : layers(net.layers_count())
+{
+    for (size_t layer = 0; layer < layers.size(); ++layer) {
+        layer_data &data = layers[layer];
+
+        data.size   = net.layer_size(layer);
+        data.inputs = net.layer_inputs(layer);
+        data.k      = net.neuron(0, layer).k_value();
+
+        for (size_t i = 1; i < data.size; ++i) {
+            if (net.neuron(i, layer).k_value() != data.k)
+                throw invalid_argument("klogic::quantized_mlmvn: neurons of a layer have different k");
+        }
+
+        for (size_t i = 0; i < data.size; ++i) {
+            if (net.neuron(i, layer).is_periodic())
+                throw invalid_argument("klogic::quantized_mlmvn: periodic neurons are not supported");
+        }
+
+        if (data.k <= 0)
+            throw invalid_argument("klogic::quantized_mlmvn: network is not discrete");
+
+        if (layer == 0)
+            data.input_k = input_k > 0 ? input_k : data.k;
+        else
+            data.input_k = layers[layer - 1].k;
+
+        quantize_layer(net, layer, data);
+    }
+}
+
+template<typename Weight>
+void klogic::quantized_mlmvn<Weight>::quantize_layer(const mlmvn &net, size_t layer,
+                                                     layer_data &data) const
+{
+    const double max = numeric_limits<Weight>::max();
+
+    // Each term is below 2*max^2 and so is the bias
+    if (data.inputs + 1 > size_t(numeric_limits<accumulator>::max() / (2 * max * max)))
+        throw invalid_argument("klogic::quantized_mlmvn: too many inputs for accumulator");
+
+    size_t n = data.inputs;
+
+    data.weights.resize(data.size * 2 * n);
+    data.bias_re.resize(data.size);
+    data.bias_im.resize(data.size);
+
+    const cmplx *w = net.layer_weights(layer);
+
+    for (size_t j = 0; j < data.size; ++j, w += n + 1) {
+        // Largest part of the row's weights gets the largest integer
+        double largest = 0;
+
+        for (size_t i = 0; i <= n; ++i)
+            largest = std::max(largest, double(std::max(fabs(w[i].real()), fabs(w[i].imag()))));
+
+        double scale = largest > 0 ? max / largest : 0;
+        Weight *row = &data.weights[j * 2 * n];
+
+        for (size_t i = 0; i < n; ++i) {
+            row[2 * i]     = fixed<Weight>(w[i + 1].real(), scale);
+            row[2 * i + 1] = fixed<Weight>(w[i + 1].imag(), scale);
+        }
+
+        // Bias is added to products of weights and roots, both scaled
+        data.bias_re[j] = fixed<accumulator>(w[0].real(), scale * max);
+        data.bias_im[j] = fixed<accumulator>(w[0].imag(), scale * max);
+    }
+
+    data.root_a.resize(2 * data.input_k);
+    data.root_b.resize(2 * data.input_k);
+
+    for (int s = 0; s < data.input_k; ++s) {
+        cmplx root = epsilon(s, data.input_k);
+        int16_t c = fixed<int16_t>(root.real(), max), sn = fixed<int16_t>(root.imag(), max);
+
+        data.root_a[2 * s] = c;
+        data.root_a[2 * s + 1] = -sn;
+        data.root_b[2 * s] = sn;
+        data.root_b[2 * s + 1] = c;
+    }
+}
+
+template<typename Weight>
+size_t klogic::quantized_mlmvn<Weight>::max_layer_inputs() const
+{
+    size_t result = input_size();
+
+    for (size_t layer = 0; layer < layers.size(); ++layer)
+        result = std::max(result, layers[layer].size);
+
+    return result;
+}
+
+template<typename Weight>
+size_t klogic::quantized_mlmvn<Weight>::weights_bytes() const
+{
+    size_t result = 0;
+
+    for (size_t layer = 0; layer < layers.size(); ++layer) {
+        const layer_data &data = layers[layer];
+
+        result += data.weights.size() * sizeof(Weight) + 2 * data.size * sizeof(accumulator);
+    }
+
+    return result;
+}
+
+template<typename Weight>
+void klogic::quantized_mlmvn<Weight>::output(const int *sectors, int *out,
+                                             quantized_workspace<Weight> &ws) const
+{
+    static const typename dot_kernel<Weight>::function dot = best_dot<Weight>();
+
+    const int *in = sectors;
+
+    for (size_t layer = 0; layer < layers.size(); ++layer) {
+        const layer_data &data = layers[layer];
+        size_t n = 2 * data.inputs;
+
+        // Roots are looked up once and shared by all neurons
+        for (size_t i = 0; i < data.inputs; ++i) {
+            assert(in[i] >= 0 && in[i] < data.input_k);
+
+            ws.x_a[2 * i]     = data.root_a[2 * in[i]];
+            ws.x_a[2 * i + 1] = data.root_a[2 * in[i] + 1];
+            ws.x_b[2 * i]     = data.root_b[2 * in[i]];
+            ws.x_b[2 * i + 1] = data.root_b[2 * in[i] + 1];
+        }
+
+        int *result = layer + 1 == layers.size() ? out : ws.sectors[layer % 2].data();
+
+        for (size_t j = 0; j < data.size; ++j) {
+            accumulator re = data.bias_re[j], im = data.bias_im[j];
+
+            dot(&data.weights[j * n], ws.x_a.data(), ws.x_b.data(), n, re, im);
+
+            ws.sums[j] = cmplx(scalar(re), scalar(im));
+        }
+
+        kernels::sectors(data.k, ws.sums.data(), data.size, result);
+
+        // Phase rounded up to 2pi gives sector k, which is sector 0
+        for (size_t j = 0; j < data.size; ++j)
+            result[j] = result[j] == data.k ? 0 : result[j];
+
+        in = result;
+    }
+}
+
+template<typename Weight>
+std::vector<int> klogic::quantized_mlmvn<Weight>::output(const std::vector<int> &sectors) const
+{
+    assert(sectors.size() == input_size());
+
+    quantized_workspace<Weight> ws(*this);
+    std::vector<int> result(output_size());
+
+    output(sectors.data(), result.data(), ws);
+
+    return result;
+}
+
+std::vector<int> klogic::to_sectors(int k, const_cspan values)
+{
+    std::vector<int> result(values.size());
+
+    // Roots lie on sector borders, so the nearest one is taken instead of
+    // sector_number()
+    for (size_t i = 0; i < values.size(); ++i)
+        result[i] = int(std::floor(phase(values[i]) / TWOPI * k + 0.5)) % k;
+
+    return result;
+}
+
+template class klogic::quantized_mlmvn<int8_t>;
+template class klogic::quantized_mlmvn<int16_t>;
@@ -0,0 +1,131 @@
+// Quantized inference of discrete MLMVN
+//
+// In a network where all neurons are discrete (k > 0) every value passed
+// between layers is a k-th root of unity, so it is given exactly by its
+// sector number. quantized_mlmvn keeps only sector numbers of inputs and
+// outputs, and the weights are stored as fixed-point complex numbers of
+// 8 or 16 bits per part instead of 2 doubles.
+//
+// A layer looks up fixed-point epsilon(n, k) for its input sectors once.
+// Then each neuron does an integer dot product of that with its weight
+// row. Weights are interleaved (re, im) and the roots are kept as
+// (re, -im) and (im, re) pairs, so a complex multiply-add is a pair of
+// 16-bit multiply-adds (pmaddwd). AVX2 versions are picked at runtime
+// like kernels::dot(). The output sector depends only on the direction
+// of the weighted sum, so each neuron gets its own weight scale and the
+// scales are not stored.
+#pragma once
+
+#include <vector>
+#include <stdint.h>
+#include "klogic.h"
+#include "mlmvn.h"
+
+namespace klogic {
+    // Integer types used with Weight: product of a weight and a root
+    // part, and the weighted sum accumulator
+    template<typename Weight>
+    struct quantized_traits {};
+
+    template<>
+    struct quantized_traits<int8_t> {
+        typedef int16_t product;
+        typedef int32_t accumulator;
+    };
+
+    template<>
+    struct quantized_traits<int16_t> {
+        typedef int32_t product;
+        typedef int64_t accumulator;
+    };
+
+    template<typename Weight>
+    class quantized_mlmvn;
+
+    // Buffers of quantized_mlmvn::output(), one per thread
+    template<typename Weight>
+    class quantized_workspace {
+    public:
+        quantized_workspace() {}
+
+        quantized_workspace(const quantized_mlmvn<Weight> &net)
+            : x_a(2 * net.max_layer_inputs()), x_b(2 * net.max_layer_inputs()),
+              sums(net.max_layer_inputs())
+        {
+            sectors[0].resize(net.max_layer_inputs());
+            sectors[1].resize(net.max_layer_inputs());
+        }
+
+    private:
+        friend class quantized_mlmvn<Weight>;
+
+        // Fixed-point roots for the layer's input sectors, see root_a
+        // and root_b of quantized_mlmvn
+        std::vector<int16_t> x_a, x_b;
+
+        // Weighted sums of a layer, converted for kernels::sectors()
+        cvector sums;
+
+        // Sectors of the layer's input and output
+        std::vector<int> sectors[2];
+    };
+
+    // Inference-only copy of a discrete mlmvn with Weight (int8_t or
+    // int16_t) fixed-point weights
+    template<typename Weight>
+    class quantized_mlmvn {
+    public:
+        typedef typename quantized_traits<Weight>::product     product;
+        typedef typename quantized_traits<Weight>::accumulator accumulator;
+
+        // Quantize weights of net. The network inputs are input_k-th
+        // roots of unity. 0 means the k of the first layer. Throws
+        // std::invalid_argument if some layer is continuous or has
+        // neurons with different k
+        explicit quantized_mlmvn(const mlmvn &net, int input_k = 0);
+
+        size_t layers_count() const { return layers.size(); }
+        size_t input_size() const   { return layers.front().inputs; }
+        size_t output_size() const  { return layers.back().size; }
+
+        // Largest of input and layer sizes
+        size_t max_layer_inputs() const;
+
+        int input_k() const  { return layers.front().input_k; }
+        int output_k() const { return layers.back().k; }
+
+        // Bytes taken by weights and biases
+        size_t weights_bytes() const;
+
+        // Output sectors for input sectors: input_size() values in
+        // [0..input_k()) at sectors, output_size() values go to out
+        void output(const int *sectors, int *out, quantized_workspace<Weight> &ws) const;
+
+        // The same with a temporary workspace
+        std::vector<int> output(const std::vector<int> &sectors) const;
+
+    private:
+        struct layer_data {
+            size_t size, inputs;
+            int k, input_k;
+
+            // Row-major, one row of `inputs` (re, im) pairs per neuron.
+            // Biases are kept scaled to accumulator units
+            std::vector<Weight> weights;
+            std::vector<accumulator> bias_re, bias_im;
+
+            // Fixed-point epsilon(n, input_k) = (c, s) as (c, -s) and
+            // (s, c) pairs: w.a and w.b are real and imaginary parts
+            // of w*epsilon
+            std::vector<int16_t> root_a, root_b;
+        };
+
+        void quantize_layer(const mlmvn &net, size_t layer, layer_data &data) const;
+
+        std::vector<layer_data> layers;
+    };
+
+    // Numbers of the nearest k-th roots of unity, e.g. sectors of
+    // transform::discrete() or discrete mlmvn output
+    std::vector<int> to_sectors(int k, const_cspan values);
+}
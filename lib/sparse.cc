@@ -0,0 +1,182 @@
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include "sparse.h"
+#include "kernels.h"
+
+using namespace std;
+
+klogic::sparse_workspace::sparse_workspace(const klogic::sparse_mlmvn &net)
+{
+    size_t largest = 0;
+
+    for (size_t layer = 0; layer < net.layers_count(); ++layer)
+        largest = std::max(largest, net.layer_size(layer));
+
+    layer1.resize(largest);
+    layer2.resize(largest);
+}
+
+//-------------------------------------------------------------------------
+
+klogic::sparse_mlmvn::sparse_mlmvn(const klogic::mlmvn &net)
+    : layers(net.layers_count())
+{
+    for (size_t layer = 0; layer < layers.size(); ++layer) {
+        layer_data &data = layers[layer];
+
+        data.size   = net.layer_size(layer);
+        data.inputs = net.layer_inputs(layer);
+
+        for (size_t i = 0; i < data.size; ++i) {
+            data.k_values.push_back(net.neuron(i, layer).k_value());
+            data.periods.push_back(net.neuron(i, layer).l_value());
+        }
+
+        data.k = data.k_values[0];
+        data.l = data.periods[0];
+
+        for (size_t i = 1; i < data.size; ++i) {
+            if (data.k_values[i] != data.k)
+                data.k = -1;
+
+            if (data.periods[i] != data.l)
+                data.l = -1;
+        }
+
+        const cmplx *row = net.layer_weights(layer);
+
+        data.bias.resize(data.size);
+        data.row_start.push_back(0);
+
+        for (size_t i = 0; i < data.size; ++i, row += data.inputs + 1) {
+            data.bias[i] = row[0];
+
+            for (size_t j = 0; j < data.inputs; ++j) {
+                if (row[j + 1] == cmplx(0))
+                    continue;
+
+                data.columns.push_back(j);
+                data.values.push_back(row[j + 1]);
+            }
+
+            data.row_start.push_back(data.values.size());
+        }
+    }
+}
+
+double klogic::sparse_mlmvn::density() const
+{
+    size_t kept = 0, total = 0;
+
+    for (size_t layer = 0; layer < layers.size(); ++layer) {
+        kept  += layers[layer].values.size();
+        total += layers[layer].size * layers[layer].inputs;
+    }
+
+    return total ? double(kept) / total : 0.0;
+}
+
+void klogic::sparse_mlmvn::calculate_layer(const layer_data &data, const cmplx *input,
+                                           cmplx *out) const
+{
+    const cmplx *w = data.values.data();
+    const uint32_t *c = data.columns.data();
+
+    for (size_t i = 0; i < data.size; ++i) {
+        uint32_t start = data.row_start[i];
+
+        out[i] = data.bias[i] + kernels::gather_dot(w + start, c + start, input,
+                                                    data.row_start[i + 1] - start);
+    }
+
+    // Activation as in mlmvn::calculate_layer()
+    if (data.k > 0 && data.l == 1) {
+        kernels::activate(data.k, out, data.size);
+    } else if (data.k > 0 && data.l > 1) {
+        kernels::activate_periodic(data.k, data.l, out, data.size);
+    } else {
+        for (size_t i = 0; i < data.size; ++i) {
+            out[i] = data.periods[i] == 1 ? kernels::activation(data.k_values[i], out[i])
+                   : kernels::periodic_activation(data.k_values[i], data.periods[i], out[i]);
+        }
+    }
+}
+
+void klogic::sparse_mlmvn::output(klogic::const_cspan X, klogic::cmplx *out,
+                                  klogic::sparse_workspace &ws) const
+{
+    assert(X.size() == input_size());
+
+    const cmplx *in = X.begin();
+
+    for (size_t layer = 0; layer < layers.size(); ++layer) {
+        cmplx *result = layer + 1 == layers.size() ? out
+                      : (layer % 2 ? ws.layer2.data() : ws.layer1.data());
+
+        calculate_layer(layers[layer], in, result);
+        in = result;
+    }
+}
+
+klogic::cvector klogic::sparse_mlmvn::output(klogic::const_cspan X) const
+{
+    sparse_workspace ws(*this);
+    cvector result(output_size());
+
+    output(X, result.data(), ws);
+
+    return result;
+}
+
+//-------------------------------------------------------------------------
+
+size_t klogic::prune(klogic::mlmvn &net, const std::vector<double> &thresholds)
+{
+    if (thresholds.size() != net.layers_count())
+        throw invalid_argument("klogic::prune(): one threshold per layer expected");
+
+    size_t pruned = 0;
+
+    for (size_t layer = 0; layer < net.layers_count(); ++layer) {
+        size_t ninputs = net.layer_inputs(layer);
+        cmplx *row = net.layer_weights(layer);
+
+        for (size_t i = 0; i < net.layer_size(layer); ++i, row += ninputs + 1) {
+            for (size_t j = 1; j <= ninputs; ++j) {
+                if (row[j] != cmplx(0) && abs(row[j]) < thresholds[layer]) {
+                    row[j] = 0;
+                    ++pruned;
+                }
+            }
+        }
+    }
+
+    return pruned;
+}
+
+double klogic::magnitude_quantile(const klogic::mlmvn &net, size_t layer, double fraction)
+{
+    size_t ninputs = net.layer_inputs(layer);
+    const cmplx *row = net.layer_weights(layer);
+    vector<double> magnitudes;
+
+    magnitudes.reserve(net.layer_size(layer) * ninputs);
+
+    for (size_t i = 0; i < net.layer_size(layer); ++i, row += ninputs + 1) {
+        for (size_t j = 1; j <= ninputs; ++j)
+            magnitudes.push_back(abs(row[j]));
+    }
+
+    size_t n = size_t(fraction * magnitudes.size());
+
+    if (n == 0)
+        return 0.0;
+
+    if (n >= magnitudes.size())
+        return *max_element(magnitudes.begin(), magnitudes.end()) * 2;
+
+    nth_element(magnitudes.begin(), magnitudes.begin() + n, magnitudes.end());
+
+    return magnitudes[n];
+}
@@ -0,0 +1,89 @@
+// Weight pruning and sparse inference of MLMVN
+//
+// prune() sets weights of small magnitude to zero, layer by layer, after
+// learning. sparse_mlmvn then keeps only nonzero weights of each layer in
+// compressed sparse row (CSR) form: for every neuron its bias, and the
+// column numbers and values of its remaining weights. Weighted sums
+// gather the inputs at those columns, so work is proportional to the
+// number of weights left.
+//
+// A pruned mlmvn may still learn. Error backpropagation skips zero
+// weights, they are connections that are no longer there (their
+// reciprocals are cached as zero, see kernels::reciprocals()). Learning
+// corrects all weights though, so pruned ones grow back unless the
+// network is pruned again.
+#pragma once
+
+#include <vector>
+#include <stdint.h>
+#include "klogic.h"
+#include "mlmvn.h"
+
+namespace klogic {
+    class sparse_mlmvn;
+
+    // Buffers of sparse_mlmvn::output(), one per thread
+    class sparse_workspace {
+    public:
+        sparse_workspace() {}
+        sparse_workspace(const sparse_mlmvn &net);
+
+    private:
+        friend class sparse_mlmvn;
+
+        // Outputs of odd and even layers
+        cvector layer1, layer2;
+    };
+
+    // Inference-only copy of mlmvn without its zero weights
+    class sparse_mlmvn {
+    public:
+        explicit sparse_mlmvn(const mlmvn &net);
+
+        size_t layers_count() const { return layers.size(); }
+        size_t input_size() const   { return layers.front().inputs; }
+        size_t output_size() const  { return layers.back().size; }
+        size_t layer_size(size_t layer) const { return layers[layer].size; }
+
+        // Weights kept in a layer, biases not counted
+        size_t nonzero_weights(size_t layer) const { return layers[layer].values.size(); }
+
+        // Share of weights kept in the whole network, biases not counted
+        double density() const;
+
+        // Network output for X, output_size() values go to out
+        void output(const_cspan X, cmplx *out, sparse_workspace &ws) const;
+
+        // The same with a temporary workspace
+        cvector output(const_cspan X) const;
+
+    private:
+        struct layer_data {
+            size_t size, inputs;
+
+            // k and l (periods) of each neuron and the ones shared by all
+            // of them, -1 if they differ
+            std::vector<int> k_values, periods;
+            int k, l;
+
+            cvector bias;
+
+            // Weights of neuron i are values[row_start[i]..row_start[i+1])
+            // for inputs columns[row_start[i]..row_start[i+1])
+            std::vector<uint32_t> row_start, columns;
+            cvector values;
+        };
+
+        void calculate_layer(const layer_data &data, const cmplx *input, cmplx *out) const;
+
+        std::vector<layer_data> layers;
+    };
+
+    // Set weights of layer l with magnitude below thresholds[l] to zero.
+    // Biases are kept. Returns number of weights pruned
+    size_t prune(mlmvn &net, const std::vector<double> &thresholds);
+
+    // Magnitude below which `fraction` (0..1) of the layer's weights are,
+    // i.e. the prune() threshold giving this sparsity. Biases don't count
+    double magnitude_quantile(const mlmvn &net, size_t layer, double fraction);
+}
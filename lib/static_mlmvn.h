@@ -0,0 +1,229 @@
+// MLMVN with topology fixed at compile time, for inference of small
+// networks
+#pragma once
+
+#include <array>
+#include <stdexcept>
+#include "klogic.h"
+#include "storage.h"
+#include "kernels.h"
+#include "mlmvn.h"
+
+namespace klogic {
+    // Layer of N neurons in K-valued logic (0 means continuous)
+    template<int N, int K>
+    struct layer {
+        static const int size = N;
+        static const int k    = K;
+    };
+
+    namespace static_detail {
+        // Activation with k known at compile time. Same results as
+        // kernels::activation() for K > 0
+        template<int K>
+        struct activation {
+            static cmplx apply(const cmplx &z) {
+                static const cmplx *roots = kernels::roots_of_unity(K);
+
+                int sector = kernels::sector_number(K, z);
+
+                // No table for huge K, no sector for NaN
+                return roots && sector >= 0 && sector <= K ? roots[sector] : klogic::activation(K, z);
+            }
+        };
+
+        // sqrt instead of hypot in std::abs, as kernels::normalize() does
+        template<>
+        struct activation<0> {
+            static cmplx apply(const cmplx &z) {
+                scalar r = std::sqrt(z.real() * z.real() + z.imag() * z.imag());
+
+                return cmplx(z.real() / r, z.imag() / r);
+            }
+        };
+
+        // w_0 + w_1*x_1 + ... + w_N*x_N, unrolled by compiler since N is
+        // a constant. Plain scalars as in kernels: std::complex
+        // multiplication does NaN/Inf recovery we don't need
+        template<int N>
+        inline cmplx weighted_sum(const cmplx *w, const cmplx *x) {
+            const scalar *pw = reinterpret_cast<const scalar *>(w + 1);
+            const scalar *px = reinterpret_cast<const scalar *>(x);
+
+            scalar re = 0, im = 0;
+
+            for (int i = 0; i < 2 * N; i += 2) {
+                re += pw[i] * px[i]     - pw[i + 1] * px[i + 1];
+                im += pw[i] * px[i + 1] + pw[i + 1] * px[i];
+            }
+
+            return w[0] + cmplx(re, im);
+        }
+
+        // Layer given its inputs count
+        template<int Inputs, typename Layer>
+        struct layer_pass {
+            static const size_t weights = Layer::size * (Inputs + 1);
+
+            static void forward(const cmplx *w, const cmplx *in, cmplx *out) {
+                for (int i = 0; i < Layer::size; ++i, w += Inputs + 1)
+                    out[i] = activation<Layer::k>::apply(weighted_sum<Inputs>(w, in));
+            }
+        };
+
+        // Layers chain. Intermediate outputs are local arrays, so they
+        // stay on stack or in registers
+        template<int Inputs, typename... Layers>
+        struct chain;
+
+        template<int Inputs, typename Last>
+        struct chain<Inputs, Last> {
+            static const size_t weights = layer_pass<Inputs, Last>::weights;
+            static const int outputs = Last::size;
+            static const int layers  = 1;
+
+            static void forward(const cmplx *w, const cmplx *in, cmplx *out) {
+                layer_pass<Inputs, Last>::forward(w, in, out);
+            }
+
+            static void sizes(std::vector<int> &s, std::vector<int> &k) {
+                s.push_back(int(Last::size));
+                k.push_back(int(Last::k));
+            }
+        };
+
+        template<int Inputs, typename First, typename Second, typename... Rest>
+        struct chain<Inputs, First, Second, Rest...> {
+            typedef layer_pass<Inputs, First> head;
+            typedef chain<First::size, Second, Rest...> tail;
+
+            static const size_t weights = head::weights + tail::weights;
+            static const int outputs = tail::outputs;
+            static const int layers  = 1 + tail::layers;
+
+            static void forward(const cmplx *w, const cmplx *in, cmplx *out) {
+                cmplx y[First::size];
+
+                head::forward(w, in, y);
+                tail::forward(w + head::weights, y, out);
+            }
+
+            static void sizes(std::vector<int> &s, std::vector<int> &k) {
+                s.push_back(int(First::size));
+                k.push_back(int(First::k));
+                tail::sizes(s, k);
+            }
+        };
+    }
+
+    // Network with topology in template parameters, e.g. 2-2-1 continuous
+    // network from test/three_classes.cc is
+    //
+    //   static_mlmvn<2, layer<2, 0>, layer<1, 0> >
+    //
+    // Weights are a fixed-size array packed like mlmvn::layer_weights()
+    // of all layers one after another. Loops have constant bounds and
+    // each layer's activation is picked at compile time, so output()
+    // doesn't allocate and small networks fit in L1 cache. There is no
+    // learning: train an mlmvn and load its weights.
+    //
+    // Weights are aligned to WEIGHTS_ALIGNMENT, which C++11 new and
+    // std::allocator don't honor. new is overloaded to return aligned
+    // memory; containers need aligned_allocator, e.g.
+    // std::vector<net_type, aligned_allocator<net_type> >
+    template<int Inputs, typename... Layers>
+    class static_mlmvn {
+        typedef static_detail::chain<Inputs, Layers...> chain;
+    public:
+        static const int    inputs        = Inputs;
+        static const int    outputs       = chain::outputs;
+        static const int    layers_count  = chain::layers;
+        static const size_t weights_count = chain::weights;
+
+        typedef std::array<cmplx, Inputs>        input_type;
+        typedef std::array<cmplx, outputs>       output_type;
+        typedef std::array<cmplx, weights_count> weights_type;
+
+        // All weights are zero
+        static_mlmvn() { w.fill(cmplx(0)); }
+
+        // Copy weights of a trained network with the same topology
+        explicit static_mlmvn(const mlmvn &net) { load(net); }
+
+        static void *operator new(size_t size) {
+            return aligned_allocator<char>().allocate(size);
+        }
+
+        static void *operator new[](size_t size) {
+            return aligned_allocator<char>().allocate(size ? size : 1);
+        }
+
+        static void operator delete(void *p)   { aligned_allocator<char>().deallocate(static_cast<char *>(p), 0); }
+        static void operator delete[](void *p) { aligned_allocator<char>().deallocate(static_cast<char *>(p), 0); }
+
+        // Placement new, hidden by the ones above, is used by containers
+        static void *operator new(size_t, void *p)  { return p; }
+        static void operator delete(void *, void *) {}
+
+        // True if net has the same sizes and k values and no periodic
+        // neurons
+        static bool matches(const mlmvn &net) {
+            std::vector<int> sizes, k_values;
+
+            chain::sizes(sizes, k_values);
+
+            if (net.input_layer_size() != size_t(Inputs) || net.layers_count() != sizes.size())
+                return false;
+
+            for (size_t layer = 0; layer < sizes.size(); ++layer) {
+                if (net.layer_size(layer) != size_t(sizes[layer]))
+                    return false;
+
+                for (int i = 0; i < sizes[layer]; ++i) {
+                    const mvn &neuron = net.neuron(i, layer);
+
+                    if (neuron.k_value() != k_values[layer] || neuron.is_periodic())
+                        return false;
+                }
+            }
+
+            return true;
+        }
+
+        // Copy weights of net. Throws std::invalid_argument if it doesn't
+        // match topology
+        void load(const mlmvn &net) {
+            if (!matches(net))
+                throw std::invalid_argument("klogic::static_mlmvn::load(): topology mismatch");
+
+            cmplx *to = w.data();
+
+            for (size_t layer = 0; layer < net.layers_count(); ++layer) {
+                size_t n = net.layer_size(layer) * (net.layer_inputs(layer) + 1);
+
+                std::copy(net.layer_weights(layer), net.layer_weights(layer) + n, to);
+                to += n;
+            }
+        }
+
+        // Packed weights of all layers
+        const weights_type &weights() const { return w; }
+        weights_type &weights()             { return w; }
+
+        // Network output for Inputs values at X, outputs values go to out
+        void output(const cmplx *X, cmplx *out) const {
+            chain::forward(w.data(), X, out);
+        }
+
+        output_type output(const input_type &X) const {
+            output_type result;
+
+            output(X.data(), result.data());
+
+            return result;
+        }
+
+    private:
+        alignas(WEIGHTS_ALIGNMENT) weights_type w;
+    };
+}
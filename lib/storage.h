@@ -0,0 +1,139 @@
+// Storage helpers for packed weight matrices
+#pragma once
+
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#include "klogic.h"
+
+namespace klogic {
+    // Alignment used for weight buffers (cache line, also enough for AVX-512)
+    const size_t WEIGHTS_ALIGNMENT = 64;
+
+    // Minimal allocator returning memory aligned to Align bytes
+    template<typename T, size_t Align = WEIGHTS_ALIGNMENT>
+    class aligned_allocator {
+    public:
+        typedef T               value_type;
+        typedef T              *pointer;
+        typedef const T        *const_pointer;
+        typedef T              &reference;
+        typedef const T        &const_reference;
+        typedef size_t          size_type;
+        typedef std::ptrdiff_t  difference_type;
+
+        template<typename U>
+        struct rebind { typedef aligned_allocator<U, Align> other; };
+
+        aligned_allocator() {}
+
+        template<typename U>
+        aligned_allocator(const aligned_allocator<U, Align> &) {}
+
+        pointer allocate(size_type n, const void * = 0) {
+            if (n == 0)
+                return 0;
+
+            void *p = 0;
+
+            if (posix_memalign(&p, Align, n * sizeof(T)) != 0)
+                throw std::bad_alloc();
+
+            return static_cast<pointer>(p);
+        }
+
+        void deallocate(pointer p, size_type) {
+            free(p);
+        }
+
+        size_type max_size() const {
+            return size_type(-1) / sizeof(T);
+        }
+
+        void construct(pointer p, const T &value) {
+            new(p) T(value);
+        }
+
+        void destroy(pointer p) {
+            p->~T();
+        }
+
+        pointer       address(reference x) const       { return &x; }
+        const_pointer address(const_reference x) const { return &x; }
+    };
+
+    template<typename T, typename U, size_t Align>
+    bool operator==(const aligned_allocator<T, Align> &, const aligned_allocator<U, Align> &) {
+        return true;
+    }
+
+    template<typename T, typename U, size_t Align>
+    bool operator!=(const aligned_allocator<T, Align> &, const aligned_allocator<U, Align> &) {
+        return false;
+    }
+
+    typedef std::vector<cmplx, aligned_allocator<cmplx> > aligned_cvector;
+
+    // ------------------
+
+    // Non-owning view of a contiguous run of complex values. Neurons inside
+    // an mlmvn point into per-layer packed buffers through such views, and
+    // learners take inputs as const_cspan, so inputs may live anywhere
+    // (vector, mapped file, ...)
+    template<typename T>
+    class basic_cspan {
+    public:
+        typedef T       value_type;
+        typedef T      *iterator;
+        typedef T      *const_iterator;
+
+        basic_cspan() : data_(0), size_(0) {}
+        basic_cspan(T *data, size_t size) : data_(data), size_(size) {}
+
+        // Allows const view to be created from mutable one
+        template<typename U>
+        basic_cspan(const basic_cspan<U> &other)
+            : data_(other.data()), size_(other.size()) {}
+
+        // View of vector contents (const views only)
+        template<typename Alloc>
+        basic_cspan(const std::vector<cmplx, Alloc> &v)
+            : data_(v.empty() ? 0 : &v[0]), size_(v.size()) {}
+
+        T *data() const { return data_; }
+        size_t size() const { return size_; }
+        bool empty() const { return size_ == 0; }
+
+        iterator begin() const { return data_; }
+        iterator end() const   { return data_ + size_; }
+
+        T &operator[](size_t i) const {
+            assert(i < size_);
+            return data_[i];
+        }
+
+        // Copy of the values
+        operator cvector() const {
+            return cvector(begin(), end());
+        }
+
+    private:
+        T *data_;
+        size_t size_;
+    };
+
+    typedef basic_cspan<cmplx>       cspan;
+    typedef basic_cspan<const cmplx> const_cspan;
+
+    typedef cspan       weights_view;
+    typedef const_cspan const_weights_view;
+
+    template<typename Stream, typename T>
+    Stream &operator<<(Stream& os, const basic_cspan<T> &v) {
+        os << '[';
+        for (T *i = v.begin(); i != v.end(); ++i) {
+            os << *i;
+        }
+        return os << ']';
+    }
+}
@@ -0,0 +1,324 @@
+// Streaming (out-of-core) learning: samples are read chunk by chunk from a
+// source instead of being kept in memory
+#pragma once
+
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "learning.h"
+#include "dataset.h"
+
+namespace klogic {
+    namespace learning {
+        // Source of samples: file, mapped dataset, generator...
+        template<typename Sample>
+        class sample_source {
+        public:
+            virtual ~sample_source() {}
+
+            // Append up to max samples to chunk. Returns number of samples
+            // appended, 0 means there are no more samples
+            virtual size_t read(std::vector<Sample> &chunk, size_t max) = 0;
+
+            // Start over from the first sample
+            virtual void rewind() = 0;
+        };
+
+        // ------------------
+
+        // Records of a dataset file decoded to learning::sample. Works for
+        // any encoding, unlike mapped_samples
+        template<typename Desired>
+        class dataset_source : public sample_source<sample<Desired> > {
+        public:
+            dataset_source(const mapped_dataset &_set)
+                : set(_set), position(0), input(_set.input_size()), desired(_set.desired_size())
+            {
+                set.advise_sequential();
+            }
+
+            size_t read(std::vector<sample<Desired> > &chunk, size_t max) {
+                size_t n = 0;
+
+                for (; n < max && position < set.size(); ++n, ++position) {
+                    set.decode(position, input.data(), desired.data());
+                    chunk.push_back(sample<Desired>(input, desired_value()));
+                }
+
+                return n;
+            }
+
+            void rewind() { position = 0; }
+
+        private:
+            Desired desired_value() const;
+
+            const mapped_dataset &set;
+            size_t position;
+            cvector input, desired;
+        };
+
+        template<>
+        inline cvector dataset_source<cvector>::desired_value() const {
+            return desired;
+        }
+
+        template<>
+        inline cmplx dataset_source<cmplx>::desired_value() const {
+            assert(desired.size() == 1);
+            return desired[0];
+        }
+
+        // Samples made by a function object, e.g. from rows of some table
+        // passed through transform::discrete() or transform::continuous().
+        // generator(chunk) appends one sample to chunk and returns true, or
+        // returns false when there are no more samples. rewind() restarts
+        // from a copy of the original generator
+        template<typename Sample, typename Generator>
+        class generator_source : public sample_source<Sample> {
+        public:
+            generator_source(const Generator &g) : initial(g), generator(g) {}
+
+            size_t read(std::vector<Sample> &chunk, size_t max) {
+                size_t n = 0;
+
+                while (n < max && generator(chunk))
+                    ++n;
+
+                return n;
+            }
+
+            void rewind() { generator = initial; }
+
+        private:
+            Generator initial, generator;
+        };
+
+        // ------------------
+
+        // Teacher for learning sets which don't fit in memory. Samples are
+        // read from the source in chunks of chunk_size. While one chunk is
+        // used for learning, a background thread reads and decodes the next
+        // one into the second buffer, so reading overlaps with computation.
+        // The reading thread lives as long as the teacher. Learner is only
+        // used by the calling thread, source only by the reading one.
+        //
+        // Chunks are passed in turn to one teacher borrowing them, so
+        // learning is the same as teacher's except that mini-batches never
+        // cross chunk boundaries (FULL_BATCH means whole chunk)
+        template<typename Learner,
+                 typename Sample     = sample<typename Learner::desired_type>,
+                 typename LearnError = learn_error <typename Sample::desired_type> >
+        class streaming_teacher {
+        public:
+            typedef teacher<Learner, Sample, LearnError> chunk_teacher;
+            typedef typename chunk_teacher::epoch_callback epoch_callback;
+
+            streaming_teacher(Learner &_learner, sample_source<Sample> &_source,
+                              size_t _chunk_size = 4096)
+                : source(_source), chunks(_learner), chunk_size(_chunk_size),
+                  count(0), epochs(0), pending(0), stopping(false)
+            {
+                assert(chunk_size > 0);
+
+                reader = std::thread(&streaming_teacher::read_loop, this);
+            }
+
+            ~streaming_teacher() {
+                {
+                    std::lock_guard<std::mutex> lock(reader_mutex);
+
+                    stopping = true;
+                    reader_wakeup.notify_all();
+                }
+
+                reader.join();
+            }
+
+            // See teacher::set_batch_size()
+            void set_batch_size(size_t size) { chunks.set_batch_size(size); }
+
+            size_t batch_size() const { return chunks.batch_size(); }
+
+            // Number of samples seen by the last pass over the source
+            int samples_count() const { return count; }
+
+            // How well learner matches the learning set
+            template <class Match>
+            int hits(Match const &match = Match()) {
+                int result = 0;
+
+                for_each_chunk([&]() {
+                    result += chunks.template hits<Match>(match);
+                });
+
+                return result;
+            }
+
+            // Make a run against source. picker instance is used to skip some items
+            template <typename SamplePicker>
+            void learn_run(SamplePicker const &picker = SamplePicker()) {
+                std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+                bool first = true;
+
+                for_each_chunk([&]() {
+                    chunks.learn_run(picker);
+
+                    // Counters of chunks are summed up
+                    if (first)
+                        run_profile = chunks.profile();
+                    else
+                        run_profile.add(chunks.profile());
+
+                    first = false;
+                });
+
+                ++epochs;
+
+                if (on_epoch) {
+                    double seconds = std::chrono::duration<double>(
+                        std::chrono::steady_clock::now() - start).count();
+
+                    on_epoch(epoch_report(epochs, count, seconds, run_profile));
+                }
+            }
+
+            // See teacher::set_epoch_callback()
+            void set_epoch_callback(const epoch_callback &callback) { on_epoch = callback; }
+
+            // Counters of the last learn_run(), see profile.h
+            const learning_profile &profile() const { return run_profile; }
+
+            // Run against whole source
+            void learn_run() {
+                learn_run<learn_always<Sample> >();
+            }
+
+            // Calculate MSE for all samples
+            template <typename SquareError>
+            double mse(SquareError const &sq_err = SquareError()) {
+                double acc_error = 0.0;
+
+                for_each_chunk([&]() {
+                    acc_error += chunks.square_error(sq_err);
+                });
+
+                return acc_error / count;
+            }
+
+        private:
+            // Non-copyable
+            streaming_teacher(const streaming_teacher &);
+            streaming_teacher &operator=(const streaming_teacher &);
+
+            // Pass all samples of the source to chunks teacher chunk by
+            // chunk and call visitor for each one, reading the next chunk
+            // in background
+            template <typename Visitor>
+            void for_each_chunk(Visitor visitor) {
+                std::vector<Sample> *current = &buffers[0], *next = &buffers[1];
+
+                source.rewind();
+                count = 0;
+
+                current->clear();
+                start_read(current);
+                finish_read();
+
+                while (!current->empty()) {
+                    count += current->size();
+                    next->clear();
+
+                    start_read(next);
+
+                    // Buffers must not be touched after return, so reading
+                    // is waited for even if visitor throws
+                    try {
+                        chunks.set_samples(sample_span<Sample>(*current));
+                        visitor();
+                    } catch (...) {
+                        wait_read();
+                        throw;
+                    }
+
+                    finish_read();
+                    std::swap(current, next);
+                }
+
+                chunks.set_samples(sample_span<Sample>());
+            }
+
+            // Let the reading thread fill buffer
+            void start_read(std::vector<Sample> *buffer) {
+                std::lock_guard<std::mutex> lock(reader_mutex);
+
+                pending = buffer;
+                read_error = std::exception_ptr();
+                reader_wakeup.notify_all();
+            }
+
+            // Wait until the buffer given to start_read() is filled
+            void wait_read() {
+                std::unique_lock<std::mutex> lock(reader_mutex);
+
+                reader_wakeup.wait(lock, [this]() { return !pending; });
+            }
+
+            // The same rethrowing exception thrown by source
+            void finish_read() {
+                wait_read();
+
+                if (read_error)
+                    std::rethrow_exception(read_error);
+            }
+
+            void read_loop() {
+                std::unique_lock<std::mutex> lock(reader_mutex);
+
+                for (;;) {
+                    reader_wakeup.wait(lock, [this]() { return stopping || pending; });
+
+                    if (stopping)
+                        return;
+
+                    std::vector<Sample> *buffer = pending;
+
+                    lock.unlock();
+
+                    try {
+                        source.read(*buffer, chunk_size);
+                    } catch (...) {
+                        read_error = std::current_exception();
+                    }
+
+                    lock.lock();
+                    pending = 0;
+                    reader_wakeup.notify_all();
+                }
+            }
+
+            sample_source<Sample> &source;
+            chunk_teacher chunks;
+            size_t chunk_size;
+            size_t count;
+            size_t epochs;
+
+            learning_profile run_profile;
+            epoch_callback on_epoch;
+
+            // Double buffer: one chunk is learned, another one is read
+            std::vector<Sample> buffers[2];
+
+            // Reading thread fills *pending and resets it. Both threads
+            // wait on reader_wakeup
+            std::thread reader;
+            std::mutex reader_mutex;
+            std::condition_variable reader_wakeup;
+            std::vector<Sample> *pending;
+            std::exception_ptr read_error;
+            bool stopping;
+        };
+    }
+}
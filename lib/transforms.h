@@ -43,7 +43,7 @@ namespace klogic {
         inline cmplx continuous(double x) {
             assert(x >= 0 && x < TWOPI);
 
-            return std::polar(1.0, x);
+            return std::polar(scalar(1), scalar(x));
         }
 
         // Continuous. Vector (0..2pi)
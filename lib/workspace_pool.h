@@ -0,0 +1,109 @@
+// Concurrent allocation-free MLMVN inference
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "mlmvn.h"
+
+namespace klogic {
+    // Pool of workspaces for mlmvn::forward() made in advance, so
+    // inference from many threads neither allocates nor locks. A thread
+    // checks out a free workspace by flipping its busy flag with
+    // compare-and-swap and returns it when done. The scan starts at a slot
+    // picked by thread id, so threads rarely compete for the same one.
+    //
+    // Pool size should be at least the number of threads calling output()
+    // at once, otherwise some of them wait for a workspace to be released.
+    // The network must not change while the pool is used
+    class mlmvn_workspace_pool {
+        struct slot {
+            slot(const mlmvn &net) : busy(false), ws(net) {}
+
+            std::atomic<bool> busy;
+            mlmvn_workspace ws;
+        };
+
+    public:
+        // Workspace checked out of the pool, returned by destructor
+        class lease {
+        public:
+            lease(lease &&other) : owner(other.owner) { other.owner = 0; }
+
+            ~lease() {
+                if (owner)
+                    owner->busy.store(false, std::memory_order_release);
+            }
+
+            mlmvn_workspace &workspace() const { return owner->ws; }
+
+        private:
+            friend class mlmvn_workspace_pool;
+
+            explicit lease(slot *s) : owner(s) {}
+
+            // Non-copyable
+            lease(const lease &);
+            lease &operator=(const lease &);
+
+            slot *owner;
+        };
+
+        // size 0 means number of hardware threads
+        explicit mlmvn_workspace_pool(const mlmvn &_net, size_t size = 0)
+            : net(_net)
+        {
+            if (size == 0)
+                size = std::max(1u, std::thread::hardware_concurrency());
+
+            for (size_t i = 0; i < size; ++i)
+                slots.push_back(std::unique_ptr<slot>(new slot(net)));
+        }
+
+        size_t size() const { return slots.size(); }
+
+        const mlmvn &network() const { return net; }
+
+        // Check out a free workspace, waiting if there is none
+        lease acquire() {
+            size_t start = std::hash<std::thread::id>()(std::this_thread::get_id()) % slots.size();
+
+            for (;;) {
+                for (size_t n = 0; n < slots.size(); ++n) {
+                    slot *s = slots[(start + n) % slots.size()].get();
+                    bool expected = false;
+
+                    // Plain load first: busy slots are skipped without
+                    // taking their cache line
+                    if (!s->busy.load(std::memory_order_relaxed)
+                        && s->busy.compare_exchange_strong(expected, true, std::memory_order_acquire))
+                        return lease(s);
+                }
+
+                std::this_thread::yield();
+            }
+        }
+
+        // Network output for X written to out, output_layer_size()
+        // values. Thread-safe, doesn't allocate
+        void output(const_cspan X, cmplx *out) {
+            lease l = acquire();
+            const cvector &result = net.forward(X, l.workspace());
+
+            std::copy(result.begin(), result.end(), out);
+        }
+
+    private:
+        // Non-copyable
+        mlmvn_workspace_pool(const mlmvn_workspace_pool &);
+        mlmvn_workspace_pool &operator=(const mlmvn_workspace_pool &);
+
+        const mlmvn &net;
+
+        // Separate allocations keep busy flags of different slots apart
+        std::vector<std::unique_ptr<slot> > slots;
+    };
+}
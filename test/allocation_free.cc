@@ -0,0 +1,121 @@
+/*
+ * Check that steady-state inference doesn't allocate: global operator new
+ * is replaced with a counting one, then several threads run the network
+ * through mlmvn_workspace_pool. mlmvn_forward reused by one thread and
+ * mlmvn::output() are counted too. Exits with 1 if pool or mlmvn_forward
+ * allocated anything
+ */
+
+#include <iostream>
+#include <cstdlib>
+#include <new>
+#include <thread>
+#include <vector>
+#include "mlmvn.h"
+#include "workspace_pool.h"
+
+using namespace std;
+using namespace klogic;
+
+// Allocations made by the current thread
+static thread_local size_t allocations = 0;
+
+void *operator new(size_t size)
+{
+    ++allocations;
+
+    if (void *p = malloc(size ? size : 1))
+        return p;
+
+    throw bad_alloc();
+}
+
+void operator delete(void *p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+    free(p);
+}
+
+const int nthreads = 4;
+const int warmup   = 10;
+const int nruns    = 1000;
+
+int main()
+{
+    vector<int> sizes(4), k_values(3);
+
+    sizes[0] = 16;
+    sizes[1] = 32;
+    sizes[2] = 32;
+    sizes[3] = 4;
+
+    k_values[0] = 0;
+    k_values[1] = 0;
+    k_values[2] = 8;
+
+    mlmvn net(sizes, k_values);
+    mlmvn_workspace_pool pool(net, nthreads);
+
+    vector<cvector> inputs(nthreads, cvector(sizes[0]));
+
+    for (int t = 0; t < nthreads; ++t) {
+        for (int i = 0; i < sizes[0]; ++i)
+            inputs[t][i] = epsilon(rand() % 8, 8);
+    }
+
+    // Count per thread, between warm-up and the end. Threads themselves
+    // are created outside of the counted part
+    vector<size_t> counted(nthreads);
+    vector<thread> threads;
+
+    for (int t = 0; t < nthreads; ++t) {
+        threads.push_back(thread([&, t]() {
+            cvector out(net.output_layer_size());
+
+            // First calls build kernel dispatch and root tables
+            for (int r = 0; r < warmup; ++r)
+                pool.output(inputs[t], out.data());
+
+            size_t before = allocations;
+
+            for (int r = 0; r < nruns; ++r)
+                pool.output(inputs[t], out.data());
+
+            counted[t] = allocations - before;
+        }));
+    }
+
+    for (int t = 0; t < nthreads; ++t)
+        threads[t].join();
+
+    size_t pool_allocations = 0;
+
+    for (int t = 0; t < nthreads; ++t)
+        pool_allocations += counted[t];
+
+    cout << "mlmvn_workspace_pool, " << nthreads << " threads: " << pool_allocations << " allocations" << endl;
+
+    mlmvn_forward forward(net);
+    cvector out(net.output_layer_size());
+    size_t before = allocations;
+
+    for (int r = 0; r < nruns; ++r)
+        forward.output(inputs[0], out.begin());
+
+    size_t forward_allocations = allocations - before;
+
+    cout << "mlmvn_forward: " << forward_allocations << " allocations" << endl;
+
+    before = allocations;
+
+    for (int r = 0; r < nruns; ++r)
+        net.output(inputs[0]);
+
+    cout << "mlmvn::output(): " << allocations - before << " allocations" << endl;
+
+    return pool_allocations == 0 && forward_allocations == 0 ? 0 : 1;
+}
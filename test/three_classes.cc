@@ -19,17 +19,17 @@ const int nsamples = 3;
 
 void set_initial_weights(mlmvn &net)
 {
-	cvector &weights0 = net.neuron(0, 0).weights_vector();
+	weights_view weights0 = net.neuron(0, 0).weights_vector();
 	weights0[0] = cmplx(0.23, -0.38);
 	weights0[1] = cmplx(0.19, -0.46);
 	weights0[2] = cmplx(0.36, -0.33);
 
-	cvector &weights1 = net.neuron(1, 0).weights_vector();
+	weights_view weights1 = net.neuron(1, 0).weights_vector();
 	weights1[0] = cmplx(0.23, -0.38);
 	weights1[1] = cmplx(0.19, -0.46);
 	weights1[2] = cmplx(0.36, -0.33);
 
-	cvector &weights2 = net.neuron(0, 1).weights_vector();
+	weights_view weights2 = net.neuron(0, 1).weights_vector();
 	weights2[0] = cmplx(0.23, -0.38);
 	weights2[1] = cmplx(0.19, -0.46);
 	weights2[2] = cmplx(0.36, -0.33);
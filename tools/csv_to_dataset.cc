@@ -0,0 +1,53 @@
+/*
+ * Convert CSV learning samples to binary dataset (see lib/dataset.h)
+ *
+ * Usage: csv_to_dataset input.csv output.mvn input_size [k] [phase|float]
+ *
+ * k > 0 means values are integers in [0..k), k = 0 (default) means
+ * phases in [0..2pi). "phase" selects PHASE encoding instead of COMPLEX,
+ * "float" selects COMPLEX_FLOAT (used in place by the float build)
+ */
+
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include "dataset.h"
+
+int main(int argc, char **argv)
+{
+    using namespace std;
+    using namespace klogic::learning;
+
+    if (argc < 4 || argc > 6) {
+        cerr << "Usage: " << argv[0] << " input.csv output.mvn input_size [k] [phase|float]" << endl;
+        return 1;
+    }
+
+    ifstream csv(argv[1]);
+
+    if (!csv) {
+        cerr << "Can't open " << argv[1] << endl;
+        return 1;
+    }
+
+    size_t input_size = strtoul(argv[3], 0, 10);
+    int k = argc > 4 ? atoi(argv[4]) : 0;
+    dataset_encoding encoding = COMPLEX;
+
+    if (argc > 5 && strcmp(argv[5], "phase") == 0)
+        encoding = PHASE;
+    else if (argc > 5 && strcmp(argv[5], "float") == 0)
+        encoding = COMPLEX_FLOAT;
+
+    try {
+        size_t count = csv_to_dataset(csv, argv[2], input_size, k, encoding);
+
+        cout << "Samples written: " << count << endl;
+    } catch (const exception &e) {
+        cerr << e.what() << endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,112 @@
+/*
+ * Accuracy of quantized inference (see lib/quantized.h) against mlmvn
+ *
+ * Usage: quantize_accuracy model.mlmvn dataset.mvn [input_k]
+ *
+ * The model is a discrete network saved by mlmvn::save(), the dataset
+ * holds its inputs as roots of unity of input_k-th logic (default: k of
+ * the dataset, or of the first layer if the dataset has k = 0) and the
+ * desired outputs. For double weights and 16- and 8-bit quantized ones
+ * prints the share of samples with all outputs right, the share of
+ * outputs equal to the double network's ones and the weights size
+ */
+
+#include <cstdlib>
+#include <iostream>
+#include <iomanip>
+#include "mlmvn.h"
+#include "quantized.h"
+#include "dataset.h"
+
+using namespace std;
+using namespace klogic;
+using namespace klogic::learning;
+
+template<typename Weight>
+void report(const char *name, const mlmvn &net, const mapped_dataset &set, int input_k,
+            const vector<vector<int> > &expected, const vector<vector<int> > &desired)
+{
+    quantized_mlmvn<Weight> q(net, input_k);
+    quantized_workspace<Weight> ws(q);
+    cvector input(set.input_size()), desired_values(set.desired_size());
+    vector<int> out(q.output_size());
+    size_t right = 0, same = 0;
+
+    for (size_t i = 0; i < set.size(); ++i) {
+        set.decode(i, input.data(), desired_values.data());
+        q.output(to_sectors(input_k, input).data(), out.data(), ws);
+
+        right += out == desired[i];
+
+        for (size_t j = 0; j < out.size(); ++j)
+            same += out[j] == expected[i][j];
+    }
+
+    cout << setw(8) << name << setw(12) << 100.0 * right / set.size() << "%"
+         << setw(12) << 100.0 * same / (set.size() * out.size()) << "%"
+         << setw(14) << q.weights_bytes() << endl;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 3 || argc > 4) {
+        cerr << "Usage: " << argv[0] << " model.mlmvn dataset.mvn [input_k]" << endl;
+        return 1;
+    }
+
+    try {
+        mlmvn net(argv[1]);
+        mapped_dataset set(argv[2]);
+
+        if (set.input_size() != net.input_layer_size() || set.desired_size() != net.output_layer_size()) {
+            cerr << "Dataset doesn't match the model" << endl;
+            return 1;
+        }
+
+        int input_k = argc > 3 ? atoi(argv[3]) : set.k();
+
+        if (input_k <= 0)
+            input_k = net.neuron(0, 0).k_value();
+
+        int output_k = net.neuron(0, net.layers_count() - 1).k_value();
+
+        mlmvn_workspace ws(net);
+        cvector input(set.input_size()), desired_values(set.desired_size());
+        vector<vector<int> > expected(set.size()), desired(set.size());
+        size_t right = 0;
+
+        set.advise_sequential();
+
+        for (size_t i = 0; i < set.size(); ++i) {
+            set.decode(i, input.data(), desired_values.data());
+
+            expected[i] = to_sectors(output_k, net.forward(input, ws));
+            desired[i]  = to_sectors(output_k, desired_values);
+
+            right += expected[i] == desired[i];
+        }
+
+        size_t n_weights = 0;
+
+        for (size_t layer = 0; layer < net.layers_count(); ++layer)
+            n_weights += net.layer_size(layer) * (net.layer_inputs(layer) + 1);
+
+        cout << "Samples: " << set.size() << ", input k: " << input_k
+             << ", output k: " << output_k << endl;
+
+        cout << setw(8) << "weights" << setw(13) << "accuracy" << setw(13) << "same"
+             << setw(14) << "bytes" << endl;
+
+        cout << fixed << setprecision(2);
+        cout << setw(8) << "double" << setw(12) << 100.0 * right / set.size() << "%"
+             << setw(13) << "" << setw(14) << n_weights * sizeof(cmplx) << endl;
+
+        report<int16_t>("int16", net, set, input_k, expected, desired);
+        report<int8_t>("int8", net, set, input_k, expected, desired);
+    } catch (const exception &e) {
+        cerr << e.what() << endl;
+        return 1;
+    }
+
+    return 0;
+}